@@ -0,0 +1,890 @@
+#include "bulk.hpp"
+
+#include <limits>
+#include <string>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BULK_X86 true
+#include <immintrin.h>
+#endif
+
+struct Kernels {
+    const char *isa;
+    void (*addi) (int*, const int*, const int*, unsigned);
+    void (*muli) (int*, const int*, const int*, unsigned);
+    void (*addd) (double*, const double*, const double*, unsigned);
+    void (*muld) (double*, const double*, const double*, unsigned);
+    int64_t (*doti) (const int*, const int*, unsigned);
+    double (*dotd) (const double*, const double*, unsigned);
+    int64_t (*sumi) (const int*, unsigned);
+    int (*mini) (const int*, unsigned);
+    int (*maxi) (const int*, unsigned);
+    double (*sumd) (const double*, unsigned);
+    double (*mind) (const double*, unsigned);
+    double (*maxd) (const double*, unsigned);
+    void (*cmpi) (BinOps, int*, const int*, const int*, unsigned);
+    void (*cmpd) (BinOps, int*, const double*, const double*, unsigned);
+};
+
+/*
+ * Scalar kernels. These are the fallback for CPUs without vector extensions
+ * and also finish off the tail of the arrays for the vector kernels. Integer
+ * arithmetic is done unsigned so it wraps around exactly like vector lanes.
+ */
+
+static void
+addi_scalar (int *d, const int *a, const int *b, unsigned n)
+{
+    for (unsigned i = 0; i < n; i++)
+        d[i] = (int) ((unsigned) a[i] + (unsigned) b[i]);
+}
+
+static void
+muli_scalar (int *d, const int *a, const int *b, unsigned n)
+{
+    for (unsigned i = 0; i < n; i++)
+        d[i] = (int) ((unsigned) a[i] * (unsigned) b[i]);
+}
+
+static void
+addd_scalar (double *d, const double *a, const double *b, unsigned n)
+{
+    for (unsigned i = 0; i < n; i++)
+        d[i] = a[i] + b[i];
+}
+
+static void
+muld_scalar (double *d, const double *a, const double *b, unsigned n)
+{
+    for (unsigned i = 0; i < n; i++)
+        d[i] = a[i] * b[i];
+}
+
+static int64_t
+doti_scalar (const int *a, const int *b, unsigned n)
+{
+    uint64_t sum = 0;
+    for (unsigned i = 0; i < n; i++)
+        sum += (uint64_t) ((int64_t) a[i] * b[i]);
+    return (int64_t) sum;
+}
+
+static double
+dotd_scalar (const double *a, const double *b, unsigned n)
+{
+    double sum = 0;
+    for (unsigned i = 0; i < n; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+static int64_t
+sumi_scalar (const int *a, unsigned n)
+{
+    int64_t sum = 0;
+    for (unsigned i = 0; i < n; i++)
+        sum += a[i];
+    return sum;
+}
+
+static int
+mini_scalar (const int *a, unsigned n)
+{
+    int m = a[0];
+    for (unsigned i = 1; i < n; i++)
+        if (a[i] < m)
+            m = a[i];
+    return m;
+}
+
+static int
+maxi_scalar (const int *a, unsigned n)
+{
+    int m = a[0];
+    for (unsigned i = 1; i < n; i++)
+        if (a[i] > m)
+            m = a[i];
+    return m;
+}
+
+static double
+sumd_scalar (const double *a, unsigned n)
+{
+    double sum = 0;
+    for (unsigned i = 0; i < n; i++)
+        sum += a[i];
+    return sum;
+}
+
+/*
+ * The smaller or larger of two doubles, or a NaN if either is one. Unlike a
+ * plain comparison this gives the same answer whichever order the elements
+ * are visited in, so every kernel agrees on it.
+ */
+
+static inline double
+min_or_nan (double x, double y)
+{
+    return x < y || x != x ? x : y;
+}
+
+static inline double
+max_or_nan (double x, double y)
+{
+    return x > y || x != x ? x : y;
+}
+
+static double
+mind_scalar (const double *a, unsigned n)
+{
+    double m = a[0];
+    for (unsigned i = 1; i < n; i++)
+        m = min_or_nan(a[i], m);
+    return m;
+}
+
+static double
+maxd_scalar (const double *a, unsigned n)
+{
+    double m = a[0];
+    for (unsigned i = 1; i < n; i++)
+        m = max_or_nan(a[i], m);
+    return m;
+}
+
+template <typename T>
+static void
+cmp_scalar (BinOps op, int *d, const T *a, const T *b, unsigned n)
+{
+    for (unsigned i = 0; i < n; i++) {
+        switch (op) {
+            case BIN_CMPLT: d[i] = a[i] < b[i];  break;
+            case BIN_CMPGT: d[i] = a[i] > b[i];  break;
+            case BIN_CMPEQ: d[i] = a[i] == b[i]; break;
+            case BIN_CMPNE: d[i] = a[i] != b[i]; break;
+            default: assert(false);
+        }
+    }
+}
+
+static void
+cmpi_scalar (BinOps op, int *d, const int *a, const int *b, unsigned n)
+{
+    cmp_scalar(op, d, a, b, n);
+}
+
+static void
+cmpd_scalar (BinOps op, int *d, const double *a, const double *b, unsigned n)
+{
+    cmp_scalar(op, d, a, b, n);
+}
+
+static const Kernels scalar_kernels = {
+    "scalar",
+    addi_scalar, muli_scalar, addd_scalar, muld_scalar,
+    doti_scalar, dotd_scalar,
+    sumi_scalar, mini_scalar, maxi_scalar,
+    sumd_scalar, mind_scalar, maxd_scalar,
+    cmpi_scalar, cmpd_scalar
+};
+
+#if defined(BULK_X86) && defined(__SSE2__)
+
+/*
+ * SSE2 kernels, 4 ints or 2 doubles at a time. SSE2 has no 32bit multiply,
+ * min or max so those are built out of what it does have. The integer dot
+ * product needs signed 64bit products which SSE2 cannot do and so it stays
+ * scalar.
+ */
+
+static void
+addi_sse2 (int *d, const int *a, const int *b, unsigned n)
+{
+    unsigned i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i*) (a + i));
+        __m128i y = _mm_loadu_si128((const __m128i*) (b + i));
+        _mm_storeu_si128((__m128i*) (d + i), _mm_add_epi32(x, y));
+    }
+    addi_scalar(d + i, a + i, b + i, n - i);
+}
+
+static inline __m128i
+mullo_sse2 (__m128i x, __m128i y)
+{
+    /* multiply the even then the odd lanes and interleave the low halves */
+    __m128i even = _mm_mul_epu32(x, y);
+    __m128i odd = _mm_mul_epu32(_mm_srli_si128(x, 4), _mm_srli_si128(y, 4));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+static void
+muli_sse2 (int *d, const int *a, const int *b, unsigned n)
+{
+    unsigned i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i*) (a + i));
+        __m128i y = _mm_loadu_si128((const __m128i*) (b + i));
+        _mm_storeu_si128((__m128i*) (d + i), mullo_sse2(x, y));
+    }
+    muli_scalar(d + i, a + i, b + i, n - i);
+}
+
+static void
+addd_sse2 (double *d, const double *a, const double *b, unsigned n)
+{
+    unsigned i = 0;
+    for (; i + 2 <= n; i += 2)
+        _mm_storeu_pd(d + i, _mm_add_pd(_mm_loadu_pd(a + i),
+                                        _mm_loadu_pd(b + i)));
+    addd_scalar(d + i, a + i, b + i, n - i);
+}
+
+static void
+muld_sse2 (double *d, const double *a, const double *b, unsigned n)
+{
+    unsigned i = 0;
+    for (; i + 2 <= n; i += 2)
+        _mm_storeu_pd(d + i, _mm_mul_pd(_mm_loadu_pd(a + i),
+                                        _mm_loadu_pd(b + i)));
+    muld_scalar(d + i, a + i, b + i, n - i);
+}
+
+static double
+dotd_sse2 (const double *a, const double *b, unsigned n)
+{
+    __m128d acc = _mm_setzero_pd();
+    double lanes[2];
+    unsigned i = 0;
+    for (; i + 2 <= n; i += 2)
+        acc = _mm_add_pd(acc, _mm_mul_pd(_mm_loadu_pd(a + i),
+                                         _mm_loadu_pd(b + i)));
+    _mm_storeu_pd(lanes, acc);
+    return lanes[0] + lanes[1] + dotd_scalar(a + i, b + i, n - i);
+}
+
+static int64_t
+sumi_sse2 (const int *a, unsigned n)
+{
+    __m128i acc = _mm_setzero_si128();
+    int64_t lanes[2];
+    unsigned i = 0;
+    for (; i + 4 <= n; i += 4) {
+        /* sign extend into 64bit lanes so the sum cannot overflow */
+        __m128i x = _mm_loadu_si128((const __m128i*) (a + i));
+        __m128i sign = _mm_srai_epi32(x, 31);
+        acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(x, sign));
+        acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(x, sign));
+    }
+    _mm_storeu_si128((__m128i*) lanes, acc);
+    return lanes[0] + lanes[1] + sumi_scalar(a + i, n - i);
+}
+
+static inline int
+hmin_epi32_sse2 (__m128i m)
+{
+    int lanes[4];
+    _mm_storeu_si128((__m128i*) lanes, m);
+    return mini_scalar(lanes, 4);
+}
+
+static inline int
+hmax_epi32_sse2 (__m128i m)
+{
+    int lanes[4];
+    _mm_storeu_si128((__m128i*) lanes, m);
+    return maxi_scalar(lanes, 4);
+}
+
+static int
+mini_sse2 (const int *a, unsigned n)
+{
+    if (n < 4)
+        return mini_scalar(a, n);
+    __m128i m = _mm_loadu_si128((const __m128i*) a);
+    unsigned i = 4;
+    for (; i + 4 <= n; i += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i*) (a + i));
+        __m128i gt = _mm_cmpgt_epi32(m, x);
+        m = _mm_or_si128(_mm_and_si128(gt, x), _mm_andnot_si128(gt, m));
+    }
+    int best = hmin_epi32_sse2(m);
+    if (i < n) {
+        int tail = mini_scalar(a + i, n - i);
+        best = tail < best ? tail : best;
+    }
+    return best;
+}
+
+static int
+maxi_sse2 (const int *a, unsigned n)
+{
+    if (n < 4)
+        return maxi_scalar(a, n);
+    __m128i m = _mm_loadu_si128((const __m128i*) a);
+    unsigned i = 4;
+    for (; i + 4 <= n; i += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i*) (a + i));
+        __m128i gt = _mm_cmpgt_epi32(x, m);
+        m = _mm_or_si128(_mm_and_si128(gt, x), _mm_andnot_si128(gt, m));
+    }
+    int best = hmax_epi32_sse2(m);
+    if (i < n) {
+        int tail = maxi_scalar(a + i, n - i);
+        best = tail > best ? tail : best;
+    }
+    return best;
+}
+
+static double
+sumd_sse2 (const double *a, unsigned n)
+{
+    __m128d acc = _mm_setzero_pd();
+    double lanes[2];
+    unsigned i = 0;
+    for (; i + 2 <= n; i += 2)
+        acc = _mm_add_pd(acc, _mm_loadu_pd(a + i));
+    _mm_storeu_pd(lanes, acc);
+    return lanes[0] + lanes[1] + sumd_scalar(a + i, n - i);
+}
+
+/*
+ * minpd and maxpd return their second operand when either is a NaN, so NaNs
+ * are looked for separately and win outright.
+ */
+
+static double
+mind_sse2 (const double *a, unsigned n)
+{
+    if (n < 2)
+        return mind_scalar(a, n);
+    __m128d m = _mm_loadu_pd(a);
+    __m128d nan = _mm_cmpunord_pd(m, m);
+    double lanes[2];
+    unsigned i = 2;
+    for (; i + 2 <= n; i += 2) {
+        __m128d x = _mm_loadu_pd(a + i);
+        nan = _mm_or_pd(nan, _mm_cmpunord_pd(x, x));
+        m = _mm_min_pd(m, x);
+    }
+    if (_mm_movemask_pd(nan))
+        return std::numeric_limits<double>::quiet_NaN();
+    _mm_storeu_pd(lanes, m);
+    double best = min_or_nan(lanes[0], lanes[1]);
+    return i < n ? min_or_nan(a[i], best) : best;
+}
+
+static double
+maxd_sse2 (const double *a, unsigned n)
+{
+    if (n < 2)
+        return maxd_scalar(a, n);
+    __m128d m = _mm_loadu_pd(a);
+    __m128d nan = _mm_cmpunord_pd(m, m);
+    double lanes[2];
+    unsigned i = 2;
+    for (; i + 2 <= n; i += 2) {
+        __m128d x = _mm_loadu_pd(a + i);
+        nan = _mm_or_pd(nan, _mm_cmpunord_pd(x, x));
+        m = _mm_max_pd(m, x);
+    }
+    if (_mm_movemask_pd(nan))
+        return std::numeric_limits<double>::quiet_NaN();
+    _mm_storeu_pd(lanes, m);
+    double best = max_or_nan(lanes[0], lanes[1]);
+    return i < n ? max_or_nan(a[i], best) : best;
+}
+
+static void
+cmpi_sse2 (BinOps op, int *d, const int *a, const int *b, unsigned n)
+{
+    const __m128i one = _mm_set1_epi32(1);
+    unsigned i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i*) (a + i));
+        __m128i y = _mm_loadu_si128((const __m128i*) (b + i));
+        __m128i m;
+        switch (op) {
+            case BIN_CMPLT: m = _mm_cmplt_epi32(x, y); break;
+            case BIN_CMPGT: m = _mm_cmpgt_epi32(x, y); break;
+            case BIN_CMPEQ: m = _mm_cmpeq_epi32(x, y); break;
+            case BIN_CMPNE: m = _mm_andnot_si128(_mm_cmpeq_epi32(x, y),
+                                                 _mm_set1_epi32(-1));
+                            break;
+            default: assert(false); return;
+        }
+        _mm_storeu_si128((__m128i*) (d + i), _mm_and_si128(m, one));
+    }
+    cmpi_scalar(op, d + i, a + i, b + i, n - i);
+}
+
+static void
+cmpd_sse2 (BinOps op, int *d, const double *a, const double *b, unsigned n)
+{
+    unsigned i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d x = _mm_loadu_pd(a + i);
+        __m128d y = _mm_loadu_pd(b + i);
+        __m128d m;
+        switch (op) {
+            case BIN_CMPLT: m = _mm_cmplt_pd(x, y);  break;
+            case BIN_CMPGT: m = _mm_cmpgt_pd(x, y);  break;
+            case BIN_CMPEQ: m = _mm_cmpeq_pd(x, y);  break;
+            case BIN_CMPNE: m = _mm_cmpneq_pd(x, y); break;
+            default: assert(false); return;
+        }
+        int bits = _mm_movemask_pd(m);
+        d[i] = bits & 1;
+        d[i + 1] = (bits >> 1) & 1;
+    }
+    cmpd_scalar(op, d + i, a + i, b + i, n - i);
+}
+
+static const Kernels sse2_kernels = {
+    "sse2",
+    addi_sse2, muli_sse2, addd_sse2, muld_sse2,
+    doti_scalar, dotd_sse2,
+    sumi_sse2, mini_sse2, maxi_sse2,
+    sumd_sse2, mind_sse2, maxd_sse2,
+    cmpi_sse2, cmpd_sse2
+};
+
+#endif
+
+#ifdef BULK_X86
+
+/*
+ * AVX2 kernels, 8 ints or 4 doubles at a time. These are compiled for AVX2
+ * regardless of the flags the rest of the program is built with and only
+ * ever called after checking the CPU supports it.
+ */
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static void
+addi_avx2 (int *d, const int *a, const int *b, unsigned n)
+{
+    unsigned i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_loadu_si256((const __m256i*) (a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i*) (b + i));
+        _mm256_storeu_si256((__m256i*) (d + i), _mm256_add_epi32(x, y));
+    }
+    addi_scalar(d + i, a + i, b + i, n - i);
+}
+
+AVX2 static void
+muli_avx2 (int *d, const int *a, const int *b, unsigned n)
+{
+    unsigned i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_loadu_si256((const __m256i*) (a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i*) (b + i));
+        _mm256_storeu_si256((__m256i*) (d + i), _mm256_mullo_epi32(x, y));
+    }
+    muli_scalar(d + i, a + i, b + i, n - i);
+}
+
+AVX2 static void
+addd_avx2 (double *d, const double *a, const double *b, unsigned n)
+{
+    unsigned i = 0;
+    for (; i + 4 <= n; i += 4)
+        _mm256_storeu_pd(d + i, _mm256_add_pd(_mm256_loadu_pd(a + i),
+                                              _mm256_loadu_pd(b + i)));
+    addd_scalar(d + i, a + i, b + i, n - i);
+}
+
+AVX2 static void
+muld_avx2 (double *d, const double *a, const double *b, unsigned n)
+{
+    unsigned i = 0;
+    for (; i + 4 <= n; i += 4)
+        _mm256_storeu_pd(d + i, _mm256_mul_pd(_mm256_loadu_pd(a + i),
+                                              _mm256_loadu_pd(b + i)));
+    muld_scalar(d + i, a + i, b + i, n - i);
+}
+
+AVX2 static int64_t
+doti_avx2 (const int *a, const int *b, unsigned n)
+{
+    __m256i acc = _mm256_setzero_si256();
+    int64_t lanes[4];
+    unsigned i = 0;
+    for (; i + 8 <= n; i += 8) {
+        /* signed 64bit products of the even lanes, then the odd lanes */
+        __m256i x = _mm256_loadu_si256((const __m256i*) (a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i*) (b + i));
+        acc = _mm256_add_epi64(acc, _mm256_mul_epi32(x, y));
+        acc = _mm256_add_epi64(acc, _mm256_mul_epi32(_mm256_srli_epi64(x, 32),
+                                                     _mm256_srli_epi64(y, 32)));
+    }
+    _mm256_storeu_si256((__m256i*) lanes, acc);
+    return (int64_t) ((uint64_t) lanes[0] + lanes[1] + lanes[2] + lanes[3]
+                      + doti_scalar(a + i, b + i, n - i));
+}
+
+AVX2 static double
+dotd_avx2 (const double *a, const double *b, unsigned n)
+{
+    __m256d acc = _mm256_setzero_pd();
+    double lanes[4];
+    unsigned i = 0;
+    for (; i + 4 <= n; i += 4)
+        acc = _mm256_add_pd(acc, _mm256_mul_pd(_mm256_loadu_pd(a + i),
+                                               _mm256_loadu_pd(b + i)));
+    _mm256_storeu_pd(lanes, acc);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3])
+         + dotd_scalar(a + i, b + i, n - i);
+}
+
+AVX2 static int64_t
+sumi_avx2 (const int *a, unsigned n)
+{
+    __m256i acc = _mm256_setzero_si256();
+    int64_t lanes[4];
+    unsigned i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i lo = _mm_loadu_si128((const __m128i*) (a + i));
+        __m128i hi = _mm_loadu_si128((const __m128i*) (a + i + 4));
+        acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(lo));
+        acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(hi));
+    }
+    _mm256_storeu_si256((__m256i*) lanes, acc);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3]
+         + sumi_scalar(a + i, n - i);
+}
+
+AVX2 static int
+mini_avx2 (const int *a, unsigned n)
+{
+    if (n < 8)
+        return mini_scalar(a, n);
+    __m256i m = _mm256_loadu_si256((const __m256i*) a);
+    int lanes[8];
+    unsigned i = 8;
+    for (; i + 8 <= n; i += 8)
+        m = _mm256_min_epi32(m, _mm256_loadu_si256((const __m256i*) (a + i)));
+    _mm256_storeu_si256((__m256i*) lanes, m);
+    int best = mini_scalar(lanes, 8);
+    if (i < n) {
+        int tail = mini_scalar(a + i, n - i);
+        best = tail < best ? tail : best;
+    }
+    return best;
+}
+
+AVX2 static int
+maxi_avx2 (const int *a, unsigned n)
+{
+    if (n < 8)
+        return maxi_scalar(a, n);
+    __m256i m = _mm256_loadu_si256((const __m256i*) a);
+    int lanes[8];
+    unsigned i = 8;
+    for (; i + 8 <= n; i += 8)
+        m = _mm256_max_epi32(m, _mm256_loadu_si256((const __m256i*) (a + i)));
+    _mm256_storeu_si256((__m256i*) lanes, m);
+    int best = maxi_scalar(lanes, 8);
+    if (i < n) {
+        int tail = maxi_scalar(a + i, n - i);
+        best = tail > best ? tail : best;
+    }
+    return best;
+}
+
+AVX2 static double
+sumd_avx2 (const double *a, unsigned n)
+{
+    __m256d acc = _mm256_setzero_pd();
+    double lanes[4];
+    unsigned i = 0;
+    for (; i + 4 <= n; i += 4)
+        acc = _mm256_add_pd(acc, _mm256_loadu_pd(a + i));
+    _mm256_storeu_pd(lanes, acc);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3])
+         + sumd_scalar(a + i, n - i);
+}
+
+AVX2 static double
+mind_avx2 (const double *a, unsigned n)
+{
+    if (n < 4)
+        return mind_scalar(a, n);
+    __m256d m = _mm256_loadu_pd(a);
+    __m256d nan = _mm256_cmp_pd(m, m, _CMP_UNORD_Q);
+    double lanes[4];
+    unsigned i = 4;
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(a + i);
+        nan = _mm256_or_pd(nan, _mm256_cmp_pd(x, x, _CMP_UNORD_Q));
+        m = _mm256_min_pd(m, x);
+    }
+    if (_mm256_movemask_pd(nan))
+        return std::numeric_limits<double>::quiet_NaN();
+    _mm256_storeu_pd(lanes, m);
+    double best = mind_scalar(lanes, 4);
+    return i < n ? min_or_nan(mind_scalar(a + i, n - i), best) : best;
+}
+
+AVX2 static double
+maxd_avx2 (const double *a, unsigned n)
+{
+    if (n < 4)
+        return maxd_scalar(a, n);
+    __m256d m = _mm256_loadu_pd(a);
+    __m256d nan = _mm256_cmp_pd(m, m, _CMP_UNORD_Q);
+    double lanes[4];
+    unsigned i = 4;
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(a + i);
+        nan = _mm256_or_pd(nan, _mm256_cmp_pd(x, x, _CMP_UNORD_Q));
+        m = _mm256_max_pd(m, x);
+    }
+    if (_mm256_movemask_pd(nan))
+        return std::numeric_limits<double>::quiet_NaN();
+    _mm256_storeu_pd(lanes, m);
+    double best = maxd_scalar(lanes, 4);
+    return i < n ? max_or_nan(maxd_scalar(a + i, n - i), best) : best;
+}
+
+AVX2 static void
+cmpi_avx2 (BinOps op, int *d, const int *a, const int *b, unsigned n)
+{
+    const __m256i one = _mm256_set1_epi32(1);
+    unsigned i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_loadu_si256((const __m256i*) (a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i*) (b + i));
+        __m256i m;
+        switch (op) {
+            case BIN_CMPLT: m = _mm256_cmpgt_epi32(y, x); break;
+            case BIN_CMPGT: m = _mm256_cmpgt_epi32(x, y); break;
+            case BIN_CMPEQ: m = _mm256_cmpeq_epi32(x, y); break;
+            case BIN_CMPNE: m = _mm256_andnot_si256(_mm256_cmpeq_epi32(x, y),
+                                                    _mm256_set1_epi32(-1));
+                            break;
+            default: assert(false); return;
+        }
+        _mm256_storeu_si256((__m256i*) (d + i), _mm256_and_si256(m, one));
+    }
+    cmpi_scalar(op, d + i, a + i, b + i, n - i);
+}
+
+AVX2 static void
+cmpd_avx2 (BinOps op, int *d, const double *a, const double *b, unsigned n)
+{
+    unsigned i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(a + i);
+        __m256d y = _mm256_loadu_pd(b + i);
+        __m256d m;
+        switch (op) {
+            case BIN_CMPLT: m = _mm256_cmp_pd(x, y, _CMP_LT_OQ);  break;
+            case BIN_CMPGT: m = _mm256_cmp_pd(x, y, _CMP_GT_OQ);  break;
+            case BIN_CMPEQ: m = _mm256_cmp_pd(x, y, _CMP_EQ_OQ);  break;
+            case BIN_CMPNE: m = _mm256_cmp_pd(x, y, _CMP_NEQ_UQ); break;
+            default: assert(false); return;
+        }
+        int bits = _mm256_movemask_pd(m);
+        for (unsigned j = 0; j < 4; j++)
+            d[i + j] = (bits >> j) & 1;
+    }
+    cmpd_scalar(op, d + i, a + i, b + i, n - i);
+}
+
+static const Kernels avx2_kernels = {
+    "avx2",
+    addi_avx2, muli_avx2, addd_avx2, muld_avx2,
+    doti_avx2, dotd_avx2,
+    sumi_avx2, mini_avx2, maxi_avx2,
+    sumd_avx2, mind_avx2, maxd_avx2,
+    cmpi_avx2, cmpd_avx2
+};
+
+#endif
+
+static const Kernels *selected = nullptr;
+
+static const Kernels&
+kernels ()
+{
+    if (selected)
+        return *selected;
+
+    selected = &scalar_kernels;
+#ifdef BULK_X86
+#ifdef __SSE2__
+    selected = &sse2_kernels;
+#endif
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        selected = &avx2_kernels;
+#endif
+    return *selected;
+}
+
+/*
+ * Checked access to an array of count elements of T at a byte offset of a
+ * chunk. Chunk memory is only as aligned as the allocator makes it which is
+ * why the kernels only ever use unaligned loads and stores.
+ */
+
+template <typename T>
+static const T*
+array (const Symbol &sym, unsigned offset, unsigned count)
+{
+    assert(sym.type() == CHUNK);
+    assert(offset + (size_t) count * sizeof(T) <= sym.bytes());
+    return reinterpret_cast<const T*>(sym.data() + offset);
+}
+
+template <typename T>
+static T*
+array (Symbol &sym, unsigned offset, unsigned count)
+{
+    assert(sym.type() == CHUNK);
+    assert(offset + (size_t) count * sizeof(T) <= sym.bytes());
+    return reinterpret_cast<T*>(sym.data() + offset);
+}
+
+void
+bulk_addi (Symbol &dst, unsigned dst_off, const Symbol &a, unsigned a_off,
+           const Symbol &b, unsigned b_off, unsigned count)
+{
+    kernels().addi(array<int>(dst, dst_off, count),
+                   array<int>(a, a_off, count),
+                   array<int>(b, b_off, count), count);
+}
+
+void
+bulk_muli (Symbol &dst, unsigned dst_off, const Symbol &a, unsigned a_off,
+           const Symbol &b, unsigned b_off, unsigned count)
+{
+    kernels().muli(array<int>(dst, dst_off, count),
+                   array<int>(a, a_off, count),
+                   array<int>(b, b_off, count), count);
+}
+
+void
+bulk_addd (Symbol &dst, unsigned dst_off, const Symbol &a, unsigned a_off,
+           const Symbol &b, unsigned b_off, unsigned count)
+{
+    kernels().addd(array<double>(dst, dst_off, count),
+                   array<double>(a, a_off, count),
+                   array<double>(b, b_off, count), count);
+}
+
+void
+bulk_muld (Symbol &dst, unsigned dst_off, const Symbol &a, unsigned a_off,
+           const Symbol &b, unsigned b_off, unsigned count)
+{
+    kernels().muld(array<double>(dst, dst_off, count),
+                   array<double>(a, a_off, count),
+                   array<double>(b, b_off, count), count);
+}
+
+int64_t
+bulk_doti (const Symbol &a, unsigned a_off,
+           const Symbol &b, unsigned b_off, unsigned count)
+{
+    return kernels().doti(array<int>(a, a_off, count),
+                          array<int>(b, b_off, count), count);
+}
+
+double
+bulk_dotd (const Symbol &a, unsigned a_off,
+           const Symbol &b, unsigned b_off, unsigned count)
+{
+    return kernels().dotd(array<double>(a, a_off, count),
+                          array<double>(b, b_off, count), count);
+}
+
+int64_t
+bulk_sumi (const Symbol &a, unsigned a_off, unsigned count)
+{
+    return kernels().sumi(array<int>(a, a_off, count), count);
+}
+
+int
+bulk_mini (const Symbol &a, unsigned a_off, unsigned count)
+{
+    assert(count > 0);
+    return kernels().mini(array<int>(a, a_off, count), count);
+}
+
+int
+bulk_maxi (const Symbol &a, unsigned a_off, unsigned count)
+{
+    assert(count > 0);
+    return kernels().maxi(array<int>(a, a_off, count), count);
+}
+
+double
+bulk_sumd (const Symbol &a, unsigned a_off, unsigned count)
+{
+    return kernels().sumd(array<double>(a, a_off, count), count);
+}
+
+double
+bulk_mind (const Symbol &a, unsigned a_off, unsigned count)
+{
+    assert(count > 0);
+    return kernels().mind(array<double>(a, a_off, count), count);
+}
+
+double
+bulk_maxd (const Symbol &a, unsigned a_off, unsigned count)
+{
+    assert(count > 0);
+    return kernels().maxd(array<double>(a, a_off, count), count);
+}
+
+void
+bulk_cmpi (BinOps op, Symbol &dst, unsigned dst_off, const Symbol &a,
+           unsigned a_off, const Symbol &b, unsigned b_off, unsigned count)
+{
+    kernels().cmpi(op, array<int>(dst, dst_off, count),
+                   array<int>(a, a_off, count),
+                   array<int>(b, b_off, count), count);
+}
+
+void
+bulk_cmpd (BinOps op, Symbol &dst, unsigned dst_off, const Symbol &a,
+           unsigned a_off, const Symbol &b, unsigned b_off, unsigned count)
+{
+    kernels().cmpd(op, array<int>(dst, dst_off, count),
+                   array<double>(a, a_off, count),
+                   array<double>(b, b_off, count), count);
+}
+
+const char*
+bulk_isa ()
+{
+    return kernels().isa;
+}
+
+bool
+bulk_use (const char *isa)
+{
+    std::string name(isa);
+    if (name == "scalar") {
+        selected = &scalar_kernels;
+        return true;
+    }
+#ifdef BULK_X86
+#ifdef __SSE2__
+    if (name == "sse2") {
+        selected = &sse2_kernels;
+        return true;
+    }
+#endif
+    __builtin_cpu_init();
+    if (name == "avx2" && __builtin_cpu_supports("avx2")) {
+        selected = &avx2_kernels;
+        return true;
+    }
+#endif
+    return false;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "symbol.hpp"
+
+/*
+ * Bulk operations over arrays of ints or doubles held in CHUNK symbols. Each
+ * array is given as a symbol and the byte offset of its first element, so
+ * arrays can be whole chunks or columns of a structure-of-arrays Layout. All
+ * arrays in one call have `count` elements.
+ *
+ * The kernels are selected once at startup by what the CPU supports: AVX2,
+ * then SSE2, then plain scalar loops. Integer arithmetic wraps around on
+ * overflow and the min or max of doubles is a NaN if any element is one, in
+ * every kernel. Results can still differ between them in the rounding of
+ * double sums and dot products, which are added in a different order, and
+ * in the sign of a zero min or max when both +0.0 and -0.0 are present.
+ */
+
+/* dst[i] = a[i] op b[i] */
+void bulk_addi (Symbol &dst, unsigned dst_off, const Symbol &a, unsigned a_off,
+                const Symbol &b, unsigned b_off, unsigned count);
+void bulk_muli (Symbol &dst, unsigned dst_off, const Symbol &a, unsigned a_off,
+                const Symbol &b, unsigned b_off, unsigned count);
+void bulk_addd (Symbol &dst, unsigned dst_off, const Symbol &a, unsigned a_off,
+                const Symbol &b, unsigned b_off, unsigned count);
+void bulk_muld (Symbol &dst, unsigned dst_off, const Symbol &a, unsigned a_off,
+                const Symbol &b, unsigned b_off, unsigned count);
+
+/* sum of a[i] * b[i] */
+int64_t bulk_doti (const Symbol &a, unsigned a_off,
+                   const Symbol &b, unsigned b_off, unsigned count);
+double bulk_dotd (const Symbol &a, unsigned a_off,
+                  const Symbol &b, unsigned b_off, unsigned count);
+
+/* reductions, min and max need at least one element */
+int64_t bulk_sumi (const Symbol &a, unsigned a_off, unsigned count);
+int bulk_mini (const Symbol &a, unsigned a_off, unsigned count);
+int bulk_maxi (const Symbol &a, unsigned a_off, unsigned count);
+double bulk_sumd (const Symbol &a, unsigned a_off, unsigned count);
+double bulk_mind (const Symbol &a, unsigned a_off, unsigned count);
+double bulk_maxd (const Symbol &a, unsigned a_off, unsigned count);
+
+/* 
+ * dst[i] = a[i] cmp b[i] as an int mask of 1s and 0s, the same values the
+ * machine's compare instructions produce. op is one of the BIN_CMP* ops.
+ */
+void bulk_cmpi (BinOps op, Symbol &dst, unsigned dst_off, const Symbol &a,
+                unsigned a_off, const Symbol &b, unsigned b_off, unsigned count);
+void bulk_cmpd (BinOps op, Symbol &dst, unsigned dst_off, const Symbol &a,
+                unsigned a_off, const Symbol &b, unsigned b_off, unsigned count);
+
+/* name of the instruction set the kernels were selected for */
+const char* bulk_isa ();
+
+/*
+ * Use the kernels for the named instruction set instead, e.g. to compare
+ * them. False if this CPU or build can't run them.
+ */
+bool bulk_use (const char *isa);
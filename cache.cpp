@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <ctype.h>
+#include "error.hpp"
+#include "cache.hpp"
+
+ExpressionCache::ExpressionCache (unsigned capacity)
+    : capacity(capacity)
+{
+    assert(capacity > 0);
+    counters.hits = 0;
+    counters.misses = 0;
+    counters.evictions = 0;
+}
+
+ExpressionCache::~ExpressionCache ()
+{
+    for (auto &e : entries)
+        delete e.expr;
+}
+
+ExpressionCache::Key
+ExpressionCache::key (const std::string &source)
+{
+    Key key;
+    key.source = normalize(source);
+    key.hash = hash(key.source);
+    return key;
+}
+
+Expression*
+ExpressionCache::find (const Key &key)
+{
+    auto it = index.find(key.hash);
+
+    if (it == index.end() || it->second->source != key.source) {
+        counters.misses++;
+        return nullptr;
+    }
+
+    /* move to the front as the most recently used */
+    entries.splice(entries.begin(), entries, it->second);
+    counters.hits++;
+    return it->second->expr;
+}
+
+Expression*
+ExpressionCache::insert (const Key &key, Expression *expr)
+{
+    Entry entry;
+    entry.source = key.source;
+    entry.hash = key.hash;
+    entry.expr = expr;
+
+    /* replace whatever had this hash, the same source or a collision */
+    auto it = index.find(entry.hash);
+    if (it != index.end()) {
+        delete it->second->expr;
+        entries.erase(it->second);
+        index.erase(it);
+    }
+
+    if (entries.size() >= capacity)
+        evict();
+
+    entries.push_front(entry);
+    index[entry.hash] = entries.begin();
+    return expr;
+}
+
+void
+ExpressionCache::evict ()
+{
+    Entry &last = entries.back();
+    index.erase(last.hash);
+    delete last.expr;
+    entries.pop_back();
+    counters.evictions++;
+}
+
+unsigned
+ExpressionCache::size () const
+{
+    return entries.size();
+}
+
+const CacheStats&
+ExpressionCache::stats () const
+{
+    return counters;
+}
+
+std::string
+ExpressionCache::normalize (const std::string &source)
+{
+    std::string out;
+    bool space = false;
+    size_t i = 0;
+
+    out.reserve(source.size());
+
+    while (i < source.size()) {
+        char c = source[i];
+
+        /* comments count as whitespace */
+        if (c == '/' && i + 1 < source.size() && source[i + 1] == '*') {
+            size_t end = source.find("*/", i + 2);
+            i = (end == std::string::npos) ? source.size() : end + 2;
+            space = true;
+            continue;
+        }
+
+        if (isspace((unsigned char) c)) {
+            space = true;
+            i++;
+            continue;
+        }
+
+        if (space && !out.empty())
+            out.push_back(' ');
+        space = false;
+
+        /* string literals are copied exactly */
+        if (c == '"') {
+            size_t end = i + 1;
+            while (end < source.size() && source[end] != '"') {
+                if (source[end] == '\\')
+                    end++;
+                end++;
+            }
+            end = std::min(end + 1, source.size());
+            out.append(source, i, end - i);
+            i = end;
+            continue;
+        }
+
+        out.push_back(c);
+        i++;
+    }
+
+    return out;
+}
+
+uint64_t
+ExpressionCache::hash (const std::string &normalized)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (unsigned char c : normalized) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
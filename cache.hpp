@@ -0,0 +1,69 @@
+#pragma once
+
+#include <list>
+#include <string>
+#include <unordered_map>
+#include "expression.hpp"
+
+struct CacheStats {
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+};
+
+/*
+ * A bounded cache of finished Expressions keyed by a hash of their source so
+ * statements which have been seen before skip straight to evaluation. Source
+ * is normalized before hashing so differences in whitespace and comments
+ * don't matter. When full the least recently used expression is evicted.
+ *
+ * Lookups go through a Key, which normalizes and hashes the source once, so
+ * a miss followed by an insert of the same source does the work only once.
+ *
+ * The cache owns its expressions. A pointer returned by `find` or `insert`
+ * is only valid until the next call to `insert`, which may evict it.
+ */
+class ExpressionCache {
+public:
+    struct Key {
+        std::string source; /* normalized */
+        uint64_t hash;
+    };
+
+    ExpressionCache (unsigned capacity);
+    ~ExpressionCache ();
+
+    /* the key of some source */
+    static Key key (const std::string &source);
+
+    /* find the expression for the key's source, NULL if not cached */
+    Expression* find (const Key &key);
+
+    /* cache a finished expression for the key's source, taking ownership */
+    Expression* insert (const Key &key, Expression *expr);
+
+    unsigned size () const;
+    const CacheStats& stats () const;
+
+    /* collapse whitespace and drop comments outside of string literals */
+    static std::string normalize (const std::string &source);
+
+    /* 64bit FNV-1a of the normalized source */
+    static uint64_t hash (const std::string &normalized);
+
+protected:
+    struct Entry {
+        uint64_t hash;
+        std::string source; /* normalized, to tell apart hash collisions */
+        Expression *expr;
+    };
+
+    void evict ();
+
+    unsigned capacity;
+    CacheStats counters;
+
+    /* most recently used at the front */
+    std::list<Entry> entries;
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+};
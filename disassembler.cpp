@@ -0,0 +1,274 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <climits>
+#include "machine.hpp"
+#include "disassembler.hpp"
+
+OpcodeInfo
+Disassembler::info (Opcode op)
+{
+    switch (op) {
+        case OP_HALT:   return { "halt",   1,  0 };
+        case OP_PUSHC:  return { "pushc",  2,  1 };
+        case OP_POP:    return { "pop",    1, -1 };
+        case OP_ADDI:   return { "add",    1, -1 };
+        case OP_SUBI:   return { "sub",    1, -1 };
+        case OP_DIVI:   return { "div",    4, -1 };
+        case OP_MULI:   return { "mul",    2, -1 };
+        case OP_LOADL:  return { "loadl",  2,  1 };
+        case OP_STOREL: return { "storel", 2, -1 };
+        case OP_CMPEQ:  return { "cmpeq",  1, -1 };
+        case OP_CMPNE:  return { "cmpne",  1, -1 };
+        case OP_CMPLT:  return { "cmplt",  1, -1 };
+        case OP_CMPGT:  return { "cmpgt",  1, -1 };
+        case OP_IFEQ:   return { "ifeq",   2, -1 };
+        case OP_IFNE:   return { "ifne",   2, -1 };
+        case OP_JMP:    return { "j",      1,  0 };
+        case OP_SETL:   return { "setl",   1,  1 };
+        case OP_ADDF:   return { "addf",   2, -1 };
+        case OP_SUBF:   return { "subf",   2, -1 };
+        case OP_DIVF:   return { "divf",   4, -1 };
+        case OP_MULF:   return { "mulf",   2, -1 };
+        /* bounds and type checks of the environment's symbol */
+        case OP_LOADG:  return { "loadg",  4,  1 };
+        case OP_STOREG: return { "storeg", 4, -1 };
+        case OP_PUSHW:  return { "pushw",  3,  2 };
+        case OP_ADDL:   return { "addl",   3, -2 };
+        case OP_SUBL:   return { "subl",   3, -2 };
+        case OP_DIVL:   return { "divl",   6, -2 };
+        case OP_MULL:   return { "mull",   3, -2 };
+        case OP_ADDD:   return { "addd",   3, -2 };
+        case OP_SUBD:   return { "subd",   3, -2 };
+        case OP_DIVD:   return { "divd",   6, -2 };
+        case OP_MULD:   return { "muld",   3, -2 };
+        /* assumes the inline cache hits */
+        case OP_LOADN:  return { "loadn",  3,  1 };
+        case OP_STOREN: return { "storen", 3, -1 };
+        default:        return { nullptr,  1,  0 };
+    }
+}
+
+/* what a word of the constant area is used as */
+typedef enum _WordUse {
+    WORD_UNUSED,
+    WORD_CONSTANT,
+    WORD_WIDE_LOW,
+    WORD_WIDE_HIGH
+} WordUse;
+
+/* depth of an instruction no path from the entry reaches */
+#define UNREACHED INT_MIN
+
+/* printf into a string of whatever length it takes */
+static std::string
+format (const char *fmt, ...)
+{
+    va_list argp;
+    va_start(argp, fmt);
+    int len = vsnprintf(nullptr, 0, fmt, argp);
+    va_end(argp);
+
+    std::string str(len > 0 ? len : 0, '\0');
+    va_start(argp, fmt);
+    vsnprintf(&str[0], str.size() + 1, fmt, argp);
+    va_end(argp);
+    return str;
+}
+
+/*
+ * The depth of the stack after every instruction. Control flow is followed
+ * from the entry with a worklist, each instruction is visited once at the
+ * depth it is first reached at, so loops terminate and the walk is linear.
+ */
+static std::vector<int>
+stack_depths (const std::vector<Instruction> &code, unsigned entry)
+{
+    std::vector<int> before(code.size(), UNREACHED);
+    std::vector<unsigned> worklist;
+
+    if (entry < code.size()) {
+        before[entry] = 0;
+        worklist.push_back(entry);
+    }
+
+    while (!worklist.empty()) {
+        unsigned pc = worklist.back();
+        worklist.pop_back();
+
+        Opcode op = get_opcode(code[pc]);
+        int depth = before[pc] + Disassembler::info(op).stack;
+
+        std::vector<int64_t> next;
+        int64_t dest = (int64_t) pc + get_imm(code[pc]);
+        if (op == OP_JMP)
+            next.push_back(dest);
+        else if (op == OP_IFEQ || op == OP_IFNE)
+            next = { (int64_t) pc + 1, dest };
+        else if (op != OP_HALT)
+            next.push_back(pc + 1);
+
+        for (auto n : next) {
+            if (n < entry || n >= (int64_t) code.size() || before[n] != UNREACHED)
+                continue;
+            before[n] = depth;
+            worklist.push_back(n);
+        }
+    }
+
+    std::vector<int> after(code.size(), UNREACHED);
+    for (unsigned pc = entry; pc < code.size(); pc++)
+        if (before[pc] != UNREACHED)
+            after[pc] = before[pc] + Disassembler::info(get_opcode(code[pc])).stack;
+    return after;
+}
+
+/*
+ * An immediate and its note, padded so the notes line up whatever the width
+ * of the immediate. Eight characters fit every 24bit immediate.
+ */
+static std::string
+annotate (int32_t imm, const std::string &note)
+{
+    return format("%-8d ; %s", imm, note.c_str());
+}
+
+static std::string
+local_name (const std::unordered_map<std::string, unsigned> &locals,
+            unsigned index)
+{
+    for (auto &p : locals)
+        if (p.second == index)
+            return p.first;
+    return "?";
+}
+
+void
+Disassembler::print (const Expression &expr, std::ostream &out)
+{
+    std::vector<Instruction> code = expr.code();
+    unsigned entry = expr.entry();
+    unsigned body = expr.body();
+    std::vector<WordUse> use(entry, WORD_UNUSED);
+    std::vector<int> depths = stack_depths(code, entry);
+
+    /* find what each word before the entry point is from what loads it */
+    for (unsigned pc = entry; pc < code.size(); pc++) {
+        Opcode op = get_opcode(code[pc]);
+        int64_t dest = (int64_t) pc + get_imm(code[pc]);
+        if (dest < 0 || dest >= entry)
+            continue;
+        if (op == OP_PUSHC) {
+            use[dest] = WORD_CONSTANT;
+        } else if (op == OP_PUSHW && dest + 1 < entry) {
+            use[dest] = WORD_WIDE_LOW;
+            use[dest + 1] = WORD_WIDE_HIGH;
+        }
+    }
+
+    out << "constants:\n";
+    for (unsigned i = 0; i < entry; i++) {
+        if (use[i] == WORD_WIDE_LOW) {
+            uint64_t bits = ((uint64_t) code[i + 1] << 32) | code[i];
+            double d;
+            memcpy(&d, &bits, sizeof(d));
+            out << format("  %04u  %08x %08x  wide %lld / %g\n",
+                          i, code[i], code[i + 1], (long long) bits, d);
+            i++;
+        } else {
+            out << format("  %04u  %08x           %s %d\n",
+                          i, code[i], use[i] == WORD_CONSTANT ? "int " : "pad ",
+                          (int32_t) code[i]);
+        }
+    }
+
+    unsigned long total = 0;
+    int max_depth = 0;
+
+    out << "locals:\n";
+    for (unsigned pc = entry; pc < code.size(); pc++) {
+        if (pc == body)
+            out << "code:\n";
+
+        Opcode op = get_opcode(code[pc]);
+        int32_t imm = get_imm(code[pc]);
+        OpcodeInfo ins = info(op);
+        std::string operand;
+
+        int64_t dest = (int64_t) pc + imm;
+        switch (op) {
+            case OP_PUSHC:
+                operand = annotate(imm, format("[%04lld] = %d", (long long) dest,
+                                 dest >= 0 && dest < (int64_t) code.size()
+                                 ? (int32_t) code[dest] : 0));
+                break;
+
+            case OP_PUSHW:
+                operand = annotate(imm, format("[%04lld]", (long long) dest));
+                break;
+
+            case OP_JMP:
+            case OP_IFEQ:
+            case OP_IFNE:
+                operand = annotate(imm, format("-> %04lld", (long long) dest));
+                break;
+
+            case OP_LOADL:
+            case OP_STOREL:
+                operand = annotate(imm, local_name(expr.locals, imm));
+                break;
+
+            case OP_SETL:
+                operand = format("%8s ; %s", "",
+                                 local_name(expr.locals, pc - entry).c_str());
+                break;
+
+            case OP_LOADN:
+            case OP_STOREN:
+                operand = annotate(imm,
+                                   imm >= 0 && imm < (int32_t) expr.names.size()
+                                   ? expr.names[imm].name : "?");
+                break;
+
+            case OP_POP:
+            case OP_LOADG:
+            case OP_STOREG:
+                operand = format("%d", imm);
+                break;
+
+            default:
+                break;
+        }
+
+        if (!ins.name)
+            operand = format("??? 0x%02x %d", op, imm);
+
+        std::string depth = "-";
+        if (depths[pc] != UNREACHED) {
+            total += ins.cost;
+            max_depth = std::max(max_depth, depths[pc]);
+            depth = std::to_string(depths[pc]);
+        }
+
+        out << format("  %04u  %-7s %-32s cost %2u  depth %s\n",
+                      pc, ins.name ? ins.name : "", operand.c_str(), ins.cost,
+                      depth.c_str());
+    }
+
+    out << format("total: %u words, %u instructions, cost %lu, max depth %d\n",
+                  (unsigned) code.size(), (unsigned) (code.size() - entry),
+                  total, max_depth);
+}
+
+unsigned long
+Disassembler::cost (const Expression &expr)
+{
+    std::vector<Instruction> code = expr.code();
+    std::vector<int> depths = stack_depths(code, expr.entry());
+    unsigned long total = 0;
+    for (unsigned pc = expr.entry(); pc < code.size(); pc++)
+        if (depths[pc] != UNREACHED)
+            total += info(get_opcode(code[pc])).cost;
+    return total;
+}
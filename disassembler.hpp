@@ -0,0 +1,43 @@
+#pragma once
+
+#include <iostream>
+#include "expression.hpp"
+
+/*
+ * Static description of an instruction used by the disassembler. Cost is a
+ * rough estimate in units of one dispatch through the switch interpreter,
+ * e.g. a division or a global costs a few dispatches. Stack is the change in
+ * the depth of the stack after executing the instruction.
+ */
+struct OpcodeInfo {
+    const char *name;
+    unsigned cost;
+    int stack;
+};
+
+/*
+ * The Disassembler prints a listing of a finished Expression: the constant
+ * area, the wide constants, the local setup and the code. Relative PUSHC and
+ * PUSHW addresses are resolved to the constant they load and jumps to their
+ * target. Every instruction is annotated with its estimated cost and the
+ * depth of the stack after it, followed by the totals for the expression.
+ *
+ * Depth is found by following control flow from the entry, taking both sides
+ * of every branch, so it is exact wherever the paths into an instruction
+ * agree. Code which can't be reached has no depth and costs nothing. The cost
+ * model is the same for every execution tier.
+ */
+class Disassembler {
+public:
+    static void print (const Expression &expr, std::ostream &out);
+
+    /* name, cost and stack effect of an opcode */
+    static OpcodeInfo info (Opcode op);
+
+    /*
+     * Static estimate of the cost of the code: every reachable instruction
+     * counted once. That is one run of straight line code, branches aren't
+     * weighted and loops are counted as a single pass.
+     */
+    static unsigned long cost (const Expression &expr);
+};
@@ -0,0 +1,190 @@
+#include "error.hpp"
+#include "machine.hpp"
+#include "encoding.hpp"
+
+#define ENCODING_MAGIC   0xE7
+#define ENCODING_VERSION 4
+
+/* 7 bits at a time, least significant first, high bit set if more follow */
+static void
+put_varint (std::vector<uint8_t> &out, uint32_t val)
+{
+    while (val >= 0x80) {
+        out.push_back((val & 0x7F) | 0x80);
+        val >>= 7;
+    }
+    out.push_back(val);
+}
+
+/* small negative immediates (relative addresses) stay small */
+static uint32_t
+zigzag (int32_t val)
+{
+    return ((uint32_t) val << 1) ^ (uint32_t) (val >> 31);
+}
+
+static int32_t
+unzigzag (uint32_t val)
+{
+    return (int32_t) (val >> 1) ^ -(int32_t) (val & 1);
+}
+
+bool
+Encoding::has_operand (Opcode op)
+{
+    switch (op) {
+        case OP_PUSHC:
+        case OP_PUSHW:
+        case OP_LOADL:
+        case OP_STOREL:
+        case OP_LOADG:
+        case OP_STOREG:
+        case OP_LOADN:
+        case OP_STOREN:
+        case OP_IFEQ:
+        case OP_IFNE:
+        case OP_JMP:
+            return true;
+
+        /* arithmetic, comparisons, OP_POP, OP_SETL and OP_HALT */
+        default:
+            return false;
+    }
+}
+
+std::vector<uint8_t>
+Encoding::encode (const Expression &expr)
+{
+    const std::vector<Instruction> &code = expr.bytecode;
+    std::vector<uint8_t> out;
+
+    assert(expr.is_finished);
+    out.reserve(code.size() * 2);
+
+    out.push_back(ENCODING_MAGIC);
+    out.push_back(ENCODING_VERSION);
+    out.push_back(expr.result);
+
+    put_varint(out, expr.entry_index);
+    for (unsigned i = 0; i < expr.entry_index; i++)
+        put_varint(out, zigzag(code[i]));
+
+    put_varint(out, expr.locals.size());
+    for (auto &p : expr.locals) {
+        put_varint(out, p.first.size());
+        out.insert(out.end(), p.first.begin(), p.first.end());
+        put_varint(out, p.second);
+    }
+
+    put_varint(out, expr.names.size());
+    for (auto &cache : expr.names) {
+        put_varint(out, cache.name.size());
+        out.insert(out.end(), cache.name.begin(), cache.name.end());
+    }
+
+    unsigned start = expr.body();
+    put_varint(out, code.size() - start);
+    for (unsigned pc = start; pc < code.size(); pc++) {
+        Opcode op = get_opcode(code[pc]);
+        out.push_back(op);
+        if (has_operand(op))
+            put_varint(out, zigzag(get_imm(code[pc])));
+    }
+
+    return out;
+}
+
+bool
+Encoding::decode (const uint8_t *data, size_t length, Expression &expr)
+{
+    const uint8_t *p = data;
+    const uint8_t *end = data + length;
+    bool ok = true;
+
+    auto varint = [&] () -> uint32_t {
+        uint32_t val = 0;
+        for (unsigned shift = 0; shift < 35; shift += 7) {
+            if (p >= end) {
+                ok = false;
+                return 0;
+            }
+            uint8_t b = *p++;
+            val |= (uint32_t) (b & 0x7F) << shift;
+            if (!(b & 0x80))
+                return val;
+        }
+        ok = false;
+        return 0;
+    };
+
+    if (length < 3 || data[0] != ENCODING_MAGIC || data[1] != ENCODING_VERSION
+        || data[2] > VALUE_DOUBLE)
+        return false;
+    ValueKind result = (ValueKind) data[2];
+    p += 3;
+
+    std::vector<Instruction> code;
+    uint32_t entry = varint();
+    /* every varint is at least a byte, so bound counts by what's left */
+    if (!ok || entry > (size_t) (end - p))
+        return false;
+    code.reserve(entry);
+    for (uint32_t i = 0; i < entry && ok; i++)
+        code.push_back(unzigzag(varint()));
+
+    std::unordered_map<std::string, unsigned> locals;
+    uint32_t num_locals = varint();
+    if (!ok || num_locals > (size_t) (end - p))
+        return false;
+    for (uint32_t i = 0; i < num_locals && ok; i++) {
+        uint32_t len = varint();
+        if (!ok || len > (size_t) (end - p))
+            return false;
+        std::string name((const char*) p, len);
+        p += len;
+        locals[name] = varint();
+    }
+    for (uint32_t i = 0; i < num_locals; i++)
+        code.push_back(create_instruction(OP_SETL));
+
+    std::vector<NameCache> names;
+    uint32_t num_names = varint();
+    if (!ok || num_names > (size_t) (end - p))
+        return false;
+    for (uint32_t i = 0; i < num_names && ok; i++) {
+        uint32_t len = varint();
+        if (!ok || len > (size_t) (end - p))
+            return false;
+        NameCache cache = { std::string((const char*) p, len), nullptr, 0 };
+        names.push_back(cache);
+        p += len;
+    }
+
+    uint32_t count = varint();
+    if (!ok || count > (size_t) (end - p))
+        return false;
+    code.reserve(code.size() + count);
+    for (uint32_t i = 0; i < count && ok; i++) {
+        if (p >= end)
+            return false;
+        Opcode op = *p++;
+        if (has_operand(op))
+            code.push_back(create_instruction(op, unzigzag(varint())));
+        else
+            code.push_back(create_instruction(op));
+    }
+
+    if (!ok || p != end || locals.size() != num_locals)
+        return false;
+
+    expr = Expression();
+    expr.bytecode.swap(code);
+    expr.entry_index = entry;
+    expr.result = result;
+    expr.locals.swap(locals);
+    expr.names.swap(names);
+    expr.num_locals = num_locals;
+    expr.is_finished = true;
+    expr.analyze();
+    return true;
+}
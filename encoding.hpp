@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vector>
+#include "expression.hpp"
+
+/*
+ * A dense encoding of finished Expressions for storing and caching programs.
+ * The executable form spends a full word on every instruction and constant.
+ * Here each opcode is a single byte and only instructions which have an
+ * immediate are followed by one, as a variable length integer. Constants
+ * are variable length too and the local setup is reduced to a count.
+ *
+ * +-------------------+
+ * |       Header      |  magic, version, result kind
+ * +-------------------+
+ * |     Constants     |  #words, each word as a varint
+ * +-------------------+
+ * |       Locals      |  #locals, each name and index
+ * +-------------------+
+ * |       Names       |  #names, the name of each inline cache
+ * +-------------------+
+ * |        Code       |  #instructions, opcode byte [+ zigzag varint]
+ * +-------------------+
+ *
+ * Decoding is a single pass writing straight into the executable form.
+ */
+class Encoding {
+public:
+    static std::vector<uint8_t> encode (const Expression &expr);
+
+    /* decode into expr, false if the encoding is malformed */
+    static bool decode (const uint8_t *data, size_t length, Expression &expr);
+
+    /* whether instructions with this opcode carry an immediate */
+    static bool has_operand (Opcode op);
+};
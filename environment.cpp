@@ -0,0 +1,522 @@
+#include <algorithm>
+#include <chrono>
+#include "error.hpp"
+#include "environment.hpp"
+
+std::vector<Symbol*> Environment::symbols;
+
+/*
+ * State of the sweep in progress. Survivors are compacted down to the write
+ * index. Only symbols below `end` (those which existed when marking finished)
+ * are swept, anything taken afterwards lives until the next cycle.
+ */
+static bool sweeping = false;
+static size_t sweep_read = 0;
+static size_t sweep_write = 0;
+static size_t sweep_end = 0;
+static CollectorStats stats = {0, 0, 0, 0, 0, 0, 0};
+static unsigned long cycle_live = 0;
+static unsigned long cycle_live_bytes = 0;
+static double cycle_pause = 0;
+
+/*
+ * The cycle being marked. Marks aren't cleared after a sweep since the
+ * symbols reached needn't be among those swept, any mark from an earlier
+ * cycle simply doesn't count.
+ */
+static unsigned long mark_cycle = 0;
+
+/* the last version handed out, a new inline cache is never valid */
+static unsigned long last_version = 0;
+
+/*
+ * The environment each taken symbol is charged to. Never destroyed, like the
+ * roots, as environments with static storage may outlive this file's statics.
+ */
+static std::unordered_map<const Symbol*, Environment*>&
+owners ()
+{
+    static auto *map = new std::unordered_map<const Symbol*, Environment*>();
+    return *map;
+}
+
+/*
+ * The environment each function held by a taken symbol is charged to and how
+ * many taken symbols hold it. A function shared by several symbols is charged
+ * once, to the environment which took the first of them, until the last of
+ * them is collected.
+ */
+struct FunctionCharge {
+    Environment *env;
+    unsigned holders;
+};
+
+static std::unordered_map<const Function*, FunctionCharge>&
+function_charges ()
+{
+    static auto *map = new std::unordered_map<const Function*, FunctionCharge>();
+    return *map;
+}
+
+/* the function a symbol holds, if any */
+static const Function*
+held_function (const Symbol *sym)
+{
+    return sym->type() == FUNCTION ? sym->function() : nullptr;
+}
+
+/* bytes taking sym charges for its function, nothing if it's already held */
+static unsigned long
+function_bytes (const Symbol *sym)
+{
+    const Function *fn = held_function(sym);
+    return fn && !function_charges().count(fn) ? fn->bytes() : 0;
+}
+
+/* count one more holder of sym's function, charged to env if it's the first */
+static void
+hold_function (const Symbol *sym, Environment *env)
+{
+    if (const Function *fn = held_function(sym)) {
+        auto &charge = function_charges().emplace(fn, FunctionCharge{env, 0})
+                       .first->second;
+        charge.holders++;
+    }
+}
+
+std::vector<Environment*>&
+Environment::roots ()
+{
+    static std::vector<Environment*> *list = new std::vector<Environment*>();
+    return *list;
+}
+
+/* strings live outside of the symbol's storage */
+unsigned long
+Environment::footprint (const Symbol *sym)
+{
+    unsigned long bytes = sizeof(Symbol) + sym->bytes();
+    if (sym->type() == STRING)
+        bytes += sym->string().length();
+    return bytes;
+}
+
+Environment::Environment ()
+    : parent(nullptr)
+    , used(sizeof(Environment))
+    , soft(0)
+    , hard(0)
+    , bindings(++last_version)
+    , is_root(true)
+{
+    roots().push_back(this);
+}
+
+Environment::Environment (Environment *parent)
+    : parent(parent)
+    , used(sizeof(Environment))
+    , soft(0)
+    , hard(0)
+    , bindings(++last_version)
+    , is_root(false)
+{
+    assert(parent);
+}
+
+Environment::~Environment ()
+{
+    for (auto child : children)
+        delete child;
+
+    /* the parent's count already includes ours, it keeps paying for them */
+    for (auto &p : owners())
+        if (p.second == this)
+            p.second = parent;
+    for (auto &p : function_charges())
+        if (p.second.env == this)
+            p.second.env = parent;
+
+    /* stubs which haven't compiled yet never can now */
+    for (auto fn : stubs)
+        fn->detach();
+
+    if (is_root) {
+        auto it = std::find(roots().begin(), roots().end(), this);
+        assert(it != roots().end());
+        roots().erase(it);
+    }
+    if (parent)
+        parent->uncharge(sizeof(Environment));
+}
+
+int
+Environment::register_constant (int val)
+{
+    return add_constant(std::to_string(val), Symbol(val).allocate());
+}
+
+int
+Environment::register_constant (float val)
+{
+    return add_constant(std::to_string(val), Symbol((double) val).allocate());
+}
+
+int
+Environment::register_constant (std::string val)
+{
+    return add_constant(val, Symbol(String::intern(val)).allocate());
+}
+
+int
+Environment::register_local (std::string name, int val)
+{
+    return add_local(name, Symbol(val).allocate());
+}
+
+int
+Environment::register_local (std::string name, float val)
+{
+    return add_local(name, Symbol((double) val).allocate());
+}
+
+int
+Environment::register_local (std::string name, std::string val)
+{
+    return add_local(name, Symbol(String(val)).allocate());
+}
+
+int
+Environment::register_function (std::string name, std::string source)
+{
+    Function *fn = new Function(source, this);
+    stubs.insert(fn);
+    return add_local(name, Symbol(fn).allocate());
+}
+
+int
+Environment::register_chunk (std::string name, unsigned size, unsigned stride)
+{
+    return add_local(name, Symbol(size, stride).allocate());
+}
+
+bool
+Environment::resize_chunk (Symbol *sym, unsigned size)
+{
+    auto it = owners().find(sym);
+    assert(it != owners().end() && it->second == this);
+    assert(sym->type() == CHUNK);
+
+    if (size > sym->bytes() && !charge(size - sym->bytes()))
+        return false;
+    if (size < sym->bytes())
+        uncharge(sym->bytes() - size);
+    sym->resize(size);
+    return true;
+}
+
+unsigned long
+Environment::bytes_used () const
+{
+    return used;
+}
+
+void
+Environment::set_quota (unsigned long soft_bytes, unsigned long hard_bytes)
+{
+    soft = soft_bytes;
+    hard = hard_bytes;
+}
+
+unsigned long
+Environment::soft_quota () const
+{
+    return soft;
+}
+
+unsigned long
+Environment::hard_quota () const
+{
+    return hard;
+}
+
+bool
+Environment::over_soft_quota () const
+{
+    return soft && used > soft;
+}
+
+bool
+Environment::fits (unsigned long bytes) const
+{
+    for (const Environment *env = this; env; env = env->parent)
+        if (env->hard && env->used + bytes > env->hard)
+            return false;
+    return true;
+}
+
+bool
+Environment::charge (unsigned long bytes)
+{
+    if (!fits(bytes))
+        return false;
+
+    for (Environment *env = this; env; env = env->parent)
+        env->used += bytes;
+    return true;
+}
+
+void
+Environment::adopt (Symbol *sym)
+{
+    if (owners().count(sym))
+        return;
+    unsigned long bytes = footprint(sym) + function_bytes(sym);
+    owners()[sym] = this;
+    hold_function(sym, this);
+    for (Environment *env = this; env; env = env->parent)
+        env->used += bytes;
+}
+
+void
+Environment::uncharge (unsigned long bytes)
+{
+    for (Environment *env = this; env; env = env->parent)
+        env->used -= std::min(bytes, env->used);
+}
+
+Symbol*
+Environment::lookup (std::string name) const
+{
+    for (const Environment *env = this; env; env = env->parent) {
+        auto it = env->symbol_table.find(name);
+        if (it != env->symbol_table.end())
+            return it->second;
+    }
+    return nullptr;
+}
+
+Symbol*
+Environment::constant (int index) const
+{
+    assert(index >= 0 && index < (int) constant_pool.size());
+    return constant_pool[index];
+}
+
+Symbol*
+Environment::local (int index) const
+{
+    assert(index >= 0 && index < (int) local_pool.size());
+    return local_pool[index];
+}
+
+int
+Environment::local_index (std::string name) const
+{
+    auto it = local_indices.find(name);
+    return it == local_indices.end() ? -1 : it->second;
+}
+
+unsigned
+Environment::local_count () const
+{
+    return local_pool.size();
+}
+
+unsigned long
+Environment::version () const
+{
+    return bindings;
+}
+
+void
+Environment::rebind ()
+{
+    bindings = ++last_version;
+    for (auto child : children)
+        child->rebind();
+}
+
+/* a child counts itself, so it's charged to this and every parent */
+Environment*
+Environment::add_child ()
+{
+    if (!charge(sizeof(Environment)))
+        return nullptr;
+    Environment *child = new Environment(this);
+    children.push_back(child);
+    return child;
+}
+
+bool
+Environment::take_symbol (Symbol *sym)
+{
+    assert(sym->is_allocated());
+    if (!charge(footprint(sym) + function_bytes(sym)))
+        return false;
+    owners()[sym] = this;
+    hold_function(sym, this);
+    symbols.push_back(sym);
+    return true;
+}
+
+int
+Environment::add_constant (std::string name, Symbol *sym)
+{
+    if (!take_symbol(sym)) {
+        delete sym;
+        return -1;
+    }
+    symbol_table[name] = sym;
+    local_indices.erase(name);
+    constant_pool.push_back(sym);
+    rebind();
+    return constant_pool.size() - 1;
+}
+
+int
+Environment::add_local (std::string name, Symbol *sym)
+{
+    if (!take_symbol(sym)) {
+        delete sym;
+        return -1;
+    }
+    symbol_table[name] = sym;
+    local_indices[name] = local_pool.size();
+    local_pool.push_back(sym);
+    rebind();
+    return local_pool.size() - 1;
+}
+
+void
+Environment::index_locals ()
+{
+    std::unordered_map<const Symbol*, int> positions;
+    for (int i = local_pool.size() - 1; i >= 0; i--)
+        positions[local_pool[i]] = i;
+
+    local_indices.clear();
+    for (auto &p : symbol_table) {
+        auto pos = positions.find(p.second);
+        if (pos != positions.end())
+            local_indices[p.first] = pos->second;
+    }
+}
+
+void
+Environment::push_roots (std::vector<Symbol*> &worklist) const
+{
+    for (auto &p : symbol_table)
+        worklist.push_back(p.second);
+    worklist.insert(worklist.end(), constant_pool.begin(), constant_pool.end());
+    worklist.insert(worklist.end(), local_pool.begin(), local_pool.end());
+    for (auto child : children)
+        child->push_roots(worklist);
+}
+
+void
+Environment::mark ()
+{
+    std::vector<Symbol*> worklist;
+
+    mark_cycle++;
+    for (auto env : roots())
+        env->push_roots(worklist);
+
+    while (!worklist.empty()) {
+        Symbol *sym = worklist.back();
+        worklist.pop_back();
+        if (!sym || sym->is_marked(mark_cycle))
+            continue;
+        sym->mark(mark_cycle);
+        if (sym->type() == REFERENCE)
+            worklist.push_back(sym->ref());
+    }
+
+    sweeping = true;
+    sweep_read = 0;
+    sweep_write = 0;
+    sweep_end = symbols.size();
+    cycle_live = 0;
+    cycle_live_bytes = 0;
+    cycle_pause = 0;
+}
+
+bool
+Environment::sweep (unsigned budget)
+{
+    for (; sweep_read < sweep_end && budget > 0; sweep_read++, budget--) {
+        Symbol *sym = symbols[sweep_read];
+        if (sym->is_marked(mark_cycle)) {
+            symbols[sweep_write++] = sym;
+            cycle_live++;
+            cycle_live_bytes += footprint(sym);
+        } else {
+            unsigned long bytes = footprint(sym);
+            auto owner = owners().find(sym);
+            if (owner != owners().end()) {
+                if (owner->second)
+                    owner->second->uncharge(bytes);
+                owners().erase(owner);
+            }
+            auto fn = function_charges().find(held_function(sym));
+            if (fn != function_charges().end() && --fn->second.holders == 0) {
+                if (fn->second.env)
+                    fn->second.env->uncharge(fn->first->bytes());
+                bytes += fn->first->bytes();
+                function_charges().erase(fn);
+            }
+            stats.freed++;
+            stats.freed_bytes += bytes;
+            delete sym;
+        }
+    }
+
+    if (sweep_read < sweep_end)
+        return false;
+
+    /* move down anything taken while the sweep was in progress */
+    for (size_t i = sweep_end; i < symbols.size(); i++) {
+        symbols[sweep_write++] = symbols[i];
+        cycle_live++;
+        cycle_live_bytes += footprint(symbols[i]);
+    }
+    symbols.resize(sweep_write);
+    sweeping = false;
+    return true;
+}
+
+bool
+Environment::collect_step (unsigned budget)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    if (!sweeping)
+        mark();
+    bool done = sweep(budget);
+
+    std::chrono::duration<double, std::micro> pause =
+        std::chrono::steady_clock::now() - start;
+    cycle_pause = std::max(cycle_pause, pause.count());
+    stats.max_pause = std::max(stats.max_pause, pause.count());
+
+    if (done) {
+        stats.collections++;
+        stats.live = cycle_live;
+        stats.live_bytes = cycle_live_bytes;
+        stats.last_pause = cycle_pause;
+    }
+    return done;
+}
+
+void
+Environment::collect ()
+{
+    while (!collect_step(symbols.size() + 1))
+        ;
+}
+
+const CollectorStats&
+Environment::collector_stats ()
+{
+    return stats;
+}
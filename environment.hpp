@@ -2,17 +2,41 @@
 
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
+#include <string>
 #include "symbol.hpp"
 
+/*
+ * Statistics for the symbol collector. Pauses are in microseconds and bytes
+ * count both the symbol and its storage.
+ */
+struct CollectorStats {
+    unsigned long collections;  /* completed collection cycles */
+    unsigned long freed;        /* symbols freed over all cycles */
+    unsigned long freed_bytes;
+    unsigned long live;         /* symbols surviving the last cycle */
+    unsigned long live_bytes;
+    double last_pause;          /* longest single step of the last cycle */
+    double max_pause;           /* longest single step ever */
+};
+
 /*
  * The Environment defines and owns symbols for evaluating an Expression.
+ *
+ * Every environment keeps a running count of the bytes it uses: itself, the
+ * symbols it owns with their storage, and the bodies its functions compile.
+ * The count of a parent includes all of its children. Soft and hard quotas
+ * can be set on any environment. Going over a soft quota is allowed, the
+ * owner can check over_soft_quota and decide what to do about it. Nothing
+ * is allocated which would take an environment or any of its parents over a
+ * hard quota, registering returns -1 and add_child NULL instead. Symbols of
+ * a destroyed environment are charged to its parent until they are
+ * collected.
  */
 class Environment {
 public:
     /* The global or root environment */
     Environment ();
-    /* For creating a child environment */
-    Environment (Environment *parent);
 
     ~Environment ();
 
@@ -22,7 +46,8 @@ public:
      * into the constant and local pools respectively for lookup via
      * instructions later ('pushc' push constant, 'lload' local load).  Both
      * constants and locals can be looked up later by their string name.  A
-     * constant's name is simply its value converted to a string.
+     * constant's name is simply its value converted to a string. String
+     * constants are interned.
      */
     int register_constant (int val);
     int register_constant (float val);
@@ -31,26 +56,150 @@ public:
     int register_local (std::string name, float val);
     int register_local (std::string name, std::string val);
 
+    /*
+     * Register a function local whose body is compiled from source against
+     * this environment the first time it is called.
+     */
+    int register_function (std::string name, std::string source);
+
+    /* Register a zeroed CHUNK local of size bytes */
+    int register_chunk (std::string name, unsigned size, unsigned stride);
+
+    /* Resize a CHUNK this environment owns, false if over a hard quota */
+    bool resize_chunk (Symbol *sym, unsigned size);
+
+    /*
+     * Bytes owned by this environment and its children, and its quotas. A
+     * quota of 0 is no quota.
+     */
+    unsigned long bytes_used () const;
+    void set_quota (unsigned long soft, unsigned long hard);
+    unsigned long soft_quota () const;
+    unsigned long hard_quota () const;
+
+    /* true while this environment uses more than its soft quota */
+    bool over_soft_quota () const;
+
+    /* true if bytes more stay under the hard quota here and in every parent */
+    bool fits (unsigned long bytes) const;
+
+    /*
+     * Bytes a symbol is charged, its storage included. A function is charged
+     * on its own, once however many symbols hold it.
+     */
+    static unsigned long footprint (const Symbol *sym);
+
     /* Find a symbol by name or in the constant/local pool by index */
     Symbol* lookup (std::string name) const;
     Symbol* constant (int index) const;
     Symbol* local (int index) const;
 
-    /* Create a new child environment */
+    /* Index of a local in this environment's pool by name or -1 */
+    int local_index (std::string name) const;
+    unsigned local_count () const;
+
+    /*
+     * Create a new child environment, owned and destroyed by this one. NULL
+     * if it would go over a hard quota.
+     */
     Environment* add_child ();
 
-    /* Take ownership of an allocated symbol */
-    void take_symbol (Symbol *sym);
+    /*
+     * Version of the bindings visible from this Environment. It changes
+     * whenever a name is bound or rebound here or in any parent, possibly
+     * shadowing one further up, and binding names elsewhere leaves it alone.
+     * No two environments ever share a version, so an inline cache of a name
+     * resolved from one environment is never valid in another.
+     */
+    unsigned long version () const;
+
+    /*
+     * Take ownership of an allocated symbol. False if it would go over a hard
+     * quota, the caller then still owns the symbol.
+     */
+    bool take_symbol (Symbol *sym);
+
+    /*
+     * Collect allocated symbols which are no longer reachable. The roots are
+     * the symbol tables and pools of every living Environment and its
+     * children, and REFERENCE symbols are followed to whatever they point to.
+     * The machine's stack holds plain values, never symbols, so it is not a
+     * root. Collection only happens when asked so symbols which have been
+     * allocated but not yet registered are never freed from under a caller.
+     *
+     * Marking is done all at once but sweeping is incremental: collect_step
+     * frees at most `budget` symbols per call and returns true once a cycle
+     * has completed. Symbols taken in the middle of a cycle survive it.
+     */
+    static void collect ();
+    static bool collect_step (unsigned budget);
+    static const CollectorStats& collector_stats ();
 
 protected:
+    /* register an allocated symbol under name into a pool */
+    int add_constant (std::string name, Symbol *sym);
+    int add_local (std::string name, Symbol *sym);
+
+    /* push every symbol this environment and its children hold */
+    void push_roots (std::vector<Symbol*> &worklist) const;
+
+    /* add bytes to this and every parent, false if any would go over */
+    bool charge (unsigned long bytes);
+    void uncharge (unsigned long bytes);
+
+    /* charge a symbol which was taken without accounting, ignoring quotas */
+    void adopt (Symbol *sym);
+
+    /* give this environment and its children new versions */
+    void rebind ();
+
+    /* rebuild local_indices from the symbol table and local pool */
+    void index_locals ();
+
     std::unordered_map<std::string, Symbol*> symbol_table;
     std::vector<Symbol*> constant_pool;
     std::vector<Symbol*> local_pool;
 
+    /* index in local_pool of every name bound to a local */
+    std::unordered_map<std::string, int> local_indices;
+
     Environment *parent;
     std::vector<Environment*> children;
 
+    unsigned long used;
+    unsigned long soft;
+    unsigned long hard;
+
+    unsigned long bindings;
+
 private:
+    friend class Image;
+    friend class Function;
+
+    /*
+     * Children are only made by add_child so every one of them is in its
+     * parent's children, where the collector finds its symbols.
+     */
+    Environment (Environment *parent);
+
+    /* whether this environment is in roots() */
+    bool is_root;
+
+    /* functions compiled against this environment, detached when it dies */
+    std::unordered_set<Function*> stubs;
+
     /* Container for all allocated symbols for all environments */
     static std::vector<Symbol*> symbols;
+
+    /*
+     * Every environment without a parent, where marking starts. Built on
+     * first use and never destroyed so environments with static storage in
+     * any file can register and unregister themselves.
+     */
+    static std::vector<Environment*>& roots ();
+
+    /* mark everything reachable and begin sweeping */
+    static void mark ();
+    /* sweep at most budget symbols, true once the sweep is complete */
+    static bool sweep (unsigned budget);
 };
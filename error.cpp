@@ -4,17 +4,18 @@
 #include "error.hpp"
 
 #define BUFFSIZE 1024
-#define ERRORMAX 5
 
-static int num_errors = 0;
 static std::ostream *out = &std::cerr; /* lmaoing @ C++ */
 
-#define PRINT_FMT_STRING() \
+#define FMT_STRING() \
     char buff[BUFFSIZE] = {0}; \
     va_list argp; \
     va_start(argp, fmt); \
     vsnprintf(buff, BUFFSIZE, fmt, argp); \
-    va_end(argp); \
+    va_end(argp);
+
+#define PRINT_FMT_STRING() \
+    FMT_STRING(); \
     *out << std::string(buff);
 
 void
@@ -24,26 +25,65 @@ set_error_output (std::ostream &output)
 }
 
 void
-panic (const char *fmt, ...)
+warning (const char *fmt, ...)
 {
-    *out << "Panic: ";
     PRINT_FMT_STRING();
-    std::exit(1);
 }
 
+Diagnostics::Diagnostics ()
+    : num_errors(0)
+{ }
+
 void
-error (const char *fmt, ...)
+Diagnostics::error (const char *fmt, ...)
 {
-    PRINT_FMT_STRING();
+    FMT_STRING();
+    lines.push_back(buff);
     num_errors++;
-    if (num_errors >= ERRORMAX) {
-        *out << "Maximum number of errors reached!\n";
-        std::exit(1);
-    }
 }
 
 void
-warning (const char *fmt, ...)
+Diagnostics::warning (const char *fmt, ...)
 {
-    PRINT_FMT_STRING();
+    FMT_STRING();
+    lines.push_back(buff);
+}
+
+void
+Diagnostics::append (const Diagnostics &other)
+{
+    lines.insert(lines.end(), other.lines.begin(), other.lines.end());
+    num_errors += other.num_errors;
+}
+
+bool
+Diagnostics::ok () const
+{
+    return num_errors == 0;
+}
+
+unsigned
+Diagnostics::errors () const
+{
+    return num_errors;
+}
+
+void
+Diagnostics::print (std::ostream &output) const
+{
+    for (auto &line : lines)
+        output << line;
+}
+
+const std::vector<std::string>&
+Diagnostics::messages () const
+{
+    return lines;
+}
+
+void
+Diagnostics::clear ()
+{
+    lines.clear();
+    num_errors = 0;
 }
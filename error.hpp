@@ -1,4 +1,8 @@
+#pragma once
+
 #include <iostream>
+#include <string>
+#include <vector>
 #include <stdarg.h>
 #include <assert.h>
 
@@ -8,17 +12,35 @@
 void set_error_output (std::ostream &out);
 
 /* 
- * Print an error message and immediately exit the program.
+ * Add a warning to be printed out. No amount of warnings will exit the program.
  */
-void panic (const char *fmt, ...);
+void warning (const char *fmt, ...);
 
-/* 
- * Add an error message to be printed out. Collects a number of errors before
- * exiting the program.
+/*
+ * Diagnostics collects the errors and warnings of a single compilation
+ * instead of printing them. Nothing is counted globally and nothing exits,
+ * so one bad script can't take down a process compiling many others.
  */
-void error (const char *fmt, ...);
+class Diagnostics {
+public:
+    Diagnostics ();
 
-/* 
- * Add a warning to be printed out. No amount of warnings will exit the program.
- */
-void warning (const char *fmt, ...);
+    void error (const char *fmt, ...);
+    void warning (const char *fmt, ...);
+
+    /* append everything collected by other, e.g. on another thread */
+    void append (const Diagnostics &other);
+
+    /* true if no errors have been collected */
+    bool ok () const;
+    unsigned errors () const;
+
+    /* print every message in the order they were collected */
+    void print (std::ostream &out) const;
+    const std::vector<std::string>& messages () const;
+    void clear ();
+
+protected:
+    std::vector<std::string> lines;
+    unsigned num_errors;
+};
@@ -1,9 +1,15 @@
+#include <algorithm>
+#include <string.h>
 #include "error.hpp"
 #include "machine.hpp"
 #include "expression.hpp"
 
+/* memo tables are dropped entirely once they get this big */
+#define MEMO_MAX 64
+
 Expression::Expression ()
-    : is_finished(false), entry_index(0), num_locals(0)
+    : is_finished(false), entry_index(0), num_locals(0), result(VALUE_NONE)
+    , pure(false), memo_version(0)
 { }
 
 /* push value of constant from addr onto the stack */
@@ -11,6 +17,7 @@ void
 Expression::push_constant (int value)
 {
     assert(!is_finished);
+    produce(0, VALUE_INT);
     create_constant_backpatch(value);
 }
 
@@ -18,6 +25,7 @@ void
 Expression::push_constant (float value)
 {
     assert(!is_finished);
+    produce(0, VALUE_INT);
     /* 
      * Need to keep the binary representation of the floating point the same
      * while in the 32bit container. This sidesteps implicit conversion to an
@@ -26,11 +34,38 @@ Expression::push_constant (float value)
     create_constant_backpatch(*reinterpret_cast<int32_t*>(&value));
 }
 
+void
+Expression::push_constant (int64_t value)
+{
+    assert(!is_finished);
+    produce(0, VALUE_LONG);
+    create_wide_backpatch(value);
+}
+
+void
+Expression::push_constant (double value)
+{
+    assert(!is_finished);
+    produce(0, VALUE_DOUBLE);
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    create_wide_backpatch(bits);
+}
+
+void
+Expression::pop ()
+{
+    assert(!is_finished);
+    produce(1, VALUE_NONE);
+    bytecode.push_back(create_instruction(OP_POP));
+}
+
 /* push the value of the local at the stack index onto stack */
 void
 Expression::load_local (std::string name)
 {
     assert(!is_finished);
+    produce(0, VALUE_INT);
     bytecode.push_back(create_instruction(OP_LOADL, add_or_get_local(name)));
 }
 
@@ -39,13 +74,55 @@ void
 Expression::store_local (std::string name)
 {
     assert(!is_finished);
+    produce(1, VALUE_NONE);
     bytecode.push_back(create_instruction(OP_STOREL, add_or_get_local(name)));
 }
 
+/*
+ * Session globals are locals of the Environment the expression is evaluated
+ * in, bound by their index in the Environment's local pool.
+ */
+void
+Expression::load_global (unsigned index)
+{
+    assert(!is_finished);
+    produce(0, VALUE_INT);
+    bytecode.push_back(create_instruction(OP_LOADG, index));
+}
+
+void
+Expression::store_global (unsigned index)
+{
+    assert(!is_finished);
+    produce(1, VALUE_NONE);
+    bytecode.push_back(create_instruction(OP_STOREG, index));
+}
+
+/*
+ * Names which aren't locals of the bound Environment itself are resolved by
+ * name at run time through its parents. Each instruction gets its own cache.
+ */
+void
+Expression::load_name (std::string name)
+{
+    assert(!is_finished);
+    produce(0, VALUE_INT);
+    bytecode.push_back(create_instruction(OP_LOADN, add_name(name)));
+}
+
+void
+Expression::store_name (std::string name)
+{
+    assert(!is_finished);
+    produce(1, VALUE_NONE);
+    bytecode.push_back(create_instruction(OP_STOREN, add_name(name)));
+}
+
 void
 Expression::addi ()
 {
     assert(!is_finished);
+    produce(2, VALUE_INT);
     bytecode.push_back(create_instruction(OP_ADDI));
 }
 
@@ -53,6 +130,7 @@ void
 Expression::subi ()
 {
     assert(!is_finished);
+    produce(2, VALUE_INT);
     bytecode.push_back(create_instruction(OP_SUBI));
 }
 
@@ -60,6 +138,7 @@ void
 Expression::muli ()
 {
     assert(!is_finished);
+    produce(2, VALUE_INT);
     bytecode.push_back(create_instruction(OP_MULI));
 }
 
@@ -67,13 +146,79 @@ void
 Expression::divi ()
 {
     assert(!is_finished);
+    produce(2, VALUE_INT);
     bytecode.push_back(create_instruction(OP_DIVI));
 }
 
+void
+Expression::addl ()
+{
+    assert(!is_finished);
+    produce(2, VALUE_LONG);
+    bytecode.push_back(create_instruction(OP_ADDL));
+}
+
+void
+Expression::subl ()
+{
+    assert(!is_finished);
+    produce(2, VALUE_LONG);
+    bytecode.push_back(create_instruction(OP_SUBL));
+}
+
+void
+Expression::mull ()
+{
+    assert(!is_finished);
+    produce(2, VALUE_LONG);
+    bytecode.push_back(create_instruction(OP_MULL));
+}
+
+void
+Expression::divl ()
+{
+    assert(!is_finished);
+    produce(2, VALUE_LONG);
+    bytecode.push_back(create_instruction(OP_DIVL));
+}
+
+void
+Expression::addd ()
+{
+    assert(!is_finished);
+    produce(2, VALUE_DOUBLE);
+    bytecode.push_back(create_instruction(OP_ADDD));
+}
+
+void
+Expression::subd ()
+{
+    assert(!is_finished);
+    produce(2, VALUE_DOUBLE);
+    bytecode.push_back(create_instruction(OP_SUBD));
+}
+
+void
+Expression::muld ()
+{
+    assert(!is_finished);
+    produce(2, VALUE_DOUBLE);
+    bytecode.push_back(create_instruction(OP_MULD));
+}
+
+void
+Expression::divd ()
+{
+    assert(!is_finished);
+    produce(2, VALUE_DOUBLE);
+    bytecode.push_back(create_instruction(OP_DIVD));
+}
+
 void
 Expression::cmplt ()
 {
     assert(!is_finished);
+    produce(2, VALUE_INT);
     bytecode.push_back(create_instruction(OP_CMPLT));
 }
 
@@ -81,6 +226,7 @@ void
 Expression::cmpgt ()
 {
     assert(!is_finished);
+    produce(2, VALUE_INT);
     bytecode.push_back(create_instruction(OP_CMPGT));
 }
 
@@ -88,6 +234,7 @@ void
 Expression::cmpeq ()
 {
     assert(!is_finished);
+    produce(2, VALUE_INT);
     bytecode.push_back(create_instruction(OP_CMPEQ));
 }
 
@@ -95,6 +242,7 @@ void
 Expression::cmpne ()
 {
     assert(!is_finished);
+    produce(2, VALUE_INT);
     bytecode.push_back(create_instruction(OP_CMPNE));
 }
 
@@ -140,6 +288,9 @@ Expression::finish ()
 
     bytecode = code;
     is_finished = true;
+    result = kinds.empty() ? VALUE_NONE : kinds.back();
+    kinds.clear();
+    analyze();
 }
 
 /* setup a local on the stack and return its index */
@@ -165,6 +316,89 @@ Expression::entry () const
     return entry_index;
 }
 
+unsigned
+Expression::body () const
+{
+    assert(is_finished);
+    return entry_index + locals.size();
+}
+
+ValueKind
+Expression::result_kind () const
+{
+    assert(is_finished);
+    return result;
+}
+
+unsigned long
+Expression::bytes () const
+{
+    unsigned long total = sizeof(Expression)
+        + bytecode.size() * sizeof(Instruction);
+    for (auto &cache : names)
+        total += sizeof(NameCache) + cache.name.size();
+    return total;
+}
+
+NameCache*
+Expression::name_cache (unsigned index)
+{
+    return index < names.size() ? &names[index] : nullptr;
+}
+
+unsigned
+Expression::name_count () const
+{
+    return names.size();
+}
+
+bool
+Expression::is_pure () const
+{
+    assert(is_finished);
+    return pure;
+}
+
+const std::vector<Instruction>&
+Expression::inputs () const
+{
+    assert(is_finished);
+    return input_loads;
+}
+
+bool
+Expression::recall (unsigned long version, const std::vector<int32_t> &key,
+                    std::vector<int32_t> &result) const
+{
+    if (version != memo_version)
+        return false;
+    auto it = memo.find(key);
+    if (it == memo.end())
+        return false;
+    result = it->second;
+    return true;
+}
+
+void
+Expression::remember (unsigned long version, const std::vector<int32_t> &key,
+                      const std::vector<int32_t> &result)
+{
+    assert(pure);
+    if (version != memo_version || memo.size() >= MEMO_MAX)
+        memo.clear();
+    memo_version = version;
+    memo[key] = result;
+}
+
+/* pop the kinds of an instruction's operands and push the kind it leaves */
+void
+Expression::produce (unsigned pops, ValueKind kind)
+{
+    kinds.resize(kinds.size() > pops ? kinds.size() - pops : 0);
+    if (kind != VALUE_NONE)
+        kinds.push_back(kind);
+}
+
 /* setup a local on the stack and return its index */
 unsigned
 Expression::add_or_get_local (std::string name)
@@ -176,6 +410,14 @@ Expression::add_or_get_local (std::string name)
     return locals.at(name);
 }
 
+unsigned
+Expression::add_name (std::string name)
+{
+    NameCache cache = { name, nullptr, 0 };
+    names.push_back(cache);
+    return names.size() - 1;
+}
+
 void
 Expression::write_locals (std::vector<Instruction> &code)
 {
@@ -197,6 +439,16 @@ Expression::create_constant_backpatch (int32_t value)
     bytecode.push_back(OP_HALT); /* placeholder */
 }
 
+void
+Expression::create_wide_backpatch (uint64_t bits)
+{
+    if (wide_constants.find(bits) == wide_constants.end())
+        wide_constants[bits] = 0;
+
+    wide_bp.push_back(std::make_pair(bytecode.size(), bits));
+    bytecode.push_back(OP_HALT); /* placeholder */
+}
+
 /* write all constants and patch with their relative addresses */
 void
 Expression::patch_constants (std::vector<Instruction> &code)
@@ -207,8 +459,17 @@ Expression::patch_constants (std::vector<Instruction> &code)
         code.push_back(p.first);
     }
 
+    /* wide constants are aligned to an even word, i.e. 8 bytes */
+    if (!wide_constants.empty() && code.size() % 2)
+        code.push_back(0);
+    for (auto &p : wide_constants) {
+        p.second = code.size();
+        code.push_back((uint32_t) p.first);
+        code.push_back((uint32_t) (p.first >> 32));
+    }
+
     /* total amout of constants and local setup before executable code */
-    unsigned header_size = constants.size() + locals.size();
+    unsigned header_size = code.size() + locals.size();
 
     for (auto p : constant_bp) {
         /* 
@@ -220,4 +481,64 @@ Expression::patch_constants (std::vector<Instruction> &code)
         int reladdr = -(push_addr + header_size - const_addr);
         bytecode[push_addr] = create_instruction(OP_PUSHC, reladdr);
     }
+
+    for (auto p : wide_bp) {
+        int push_addr = p.first;
+        int const_addr = wide_constants[p.second];
+        int reladdr = -(push_addr + header_size - const_addr);
+        bytecode[push_addr] = create_instruction(OP_PUSHW, reladdr);
+    }
+}
+
+void
+Expression::analyze ()
+{
+    pure = true;
+    input_loads.clear();
+    memo.clear();
+
+    for (unsigned pc = body(); pc < bytecode.size() && pure; pc++) {
+        Instruction ins = bytecode[pc];
+        switch (get_opcode(ins)) {
+            case OP_HALT:
+            case OP_PUSHC:
+            case OP_ADDI:
+            case OP_SUBI:
+            case OP_MULI:
+            case OP_DIVI:
+            case OP_CMPEQ:
+            case OP_CMPNE:
+            case OP_CMPLT:
+            case OP_CMPGT:
+            case OP_PUSHW:
+            case OP_ADDL:
+            case OP_SUBL:
+            case OP_MULL:
+            case OP_DIVL:
+            case OP_ADDD:
+            case OP_SUBD:
+            case OP_MULD:
+            case OP_DIVD:
+            case OP_POP:
+            case OP_LOADL:
+            case OP_STOREL:
+                break;
+
+            case OP_LOADG:
+            case OP_LOADN:
+                input_loads.push_back(ins);
+                break;
+
+            default:
+                pure = false;
+                break;
+        }
+    }
+
+    /* a global loaded more than once is only read once */
+    std::sort(input_loads.begin(), input_loads.end());
+    input_loads.erase(std::unique(input_loads.begin(), input_loads.end()),
+                      input_loads.end());
+    if (!pure)
+        input_loads.clear();
 }
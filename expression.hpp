@@ -1,11 +1,38 @@
 #pragma once
 
 #include "instructions.hpp"
+#include <map>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 #include <string>
 
+class Symbol;
+
+/*
+ * Inline cache of a name resolved at run time. Every instruction which loads
+ * or stores by name has its own, remembering what the name resolved to and
+ * the version of the Environment it was resolved from. The name only needs
+ * resolving again once a binding visible from there has changed, or the
+ * expression is evaluated in another environment.
+ */
+struct NameCache {
+    std::string name;
+    Symbol *symbol;
+    unsigned long version;
+};
+
+/*
+ * What a value on the stack is. Wide values take two slots. VALUE_NONE is
+ * for an expression which leaves nothing of its own on the stack.
+ */
+enum ValueKind {
+    VALUE_NONE,
+    VALUE_INT,
+    VALUE_LONG,
+    VALUE_DOUBLE
+};
+
 enum BinOps {
     BIN_ADD,
     BIN_MUL,
@@ -34,6 +61,11 @@ public:
     /* push value of constant value onto the stack */
     void push_constant (int value);
     void push_constant (float value);
+    void push_constant (int64_t value);
+    void push_constant (double value);
+
+    /* discard the value on top of the stack */
+    void pop ();
 
     /* push the value of the local at the stack index onto stack */
     void load_local (std::string name);
@@ -41,12 +73,36 @@ public:
     /* store the value on the stack into the local */
     void store_local (std::string name);
 
+    /* push the value of the session global at the index onto stack */
+    void load_global (unsigned index);
+
+    /* store the value on the stack into the session global */
+    void store_global (unsigned index);
+
+    /* push the value bound to name in the environment chain onto stack */
+    void load_name (std::string name);
+
+    /* store the value on the stack into the value bound to name */
+    void store_name (std::string name);
+
     /* integer arithmetic */
     void addi ();
     void subi ();
     void muli ();
     void divi ();
 
+    /* 64bit integer arithmetic */
+    void addl ();
+    void subl ();
+    void mull ();
+    void divl ();
+
+    /* double arithmetic */
+    void addd ();
+    void subd ();
+    void muld ();
+    void divd ();
+
     /* comparisons */
     void cmplt ();
     void cmpgt ();
@@ -72,12 +128,61 @@ public:
     /* get the entry point of the generated code */
     unsigned entry () const;
 
+    /* get the first instruction after the local setup */
+    unsigned body () const;
+
+    /* what the expression leaves on top of the stack */
+    ValueKind result_kind () const;
+
+    /* bytes taken by the expression, its code and its inline caches */
+    unsigned long bytes () const;
+
+    /* the inline cache of a LOADN or STOREN, NULL if there is no such cache */
+    NameCache* name_cache (unsigned index);
+    unsigned name_count () const;
+
+    /*
+     * An expression is pure if it pushes constants, does arithmetic or
+     * comparisons, uses its own locals and loads globals or names but never
+     * stores to them. Its locals start out zeroed on every run, so its result
+     * depends on nothing but the values of the globals and names it loads,
+     * its inputs, and it can be memoized.
+     */
+    bool is_pure () const;
+
+    /* the distinct LOADG and LOADN instructions reading its inputs */
+    const std::vector<Instruction>& inputs () const;
+
+    /* 
+     * Look up or remember the values a pure expression left on the stack
+     * given the values of its inputs. Which symbols the inputs are depends
+     * on the bindings, so everything remembered is forgotten once the
+     * version of the bound Environment is no longer the one it was
+     * remembered at.
+     */
+    bool recall (unsigned long version, const std::vector<int32_t> &key,
+                 std::vector<int32_t> &result) const;
+    void remember (unsigned long version, const std::vector<int32_t> &key,
+                   const std::vector<int32_t> &result);
+
 protected:
+    friend class Image;
+    friend class Linker;
+    friend class Encoding;
+    friend class Disassembler;
+
     /* add a local if it doesn't exist otherwise get it */
     unsigned add_or_get_local (std::string name);
 
+    /* track the kinds of values on the stack while building */
+    void produce (unsigned pops, ValueKind kind);
+
+    /* add a new, empty inline cache for name */
+    unsigned add_name (std::string name);
+
     /* add a constant and produce a backpatch for current instruction */
     void create_constant_backpatch (int32_t value);
+    void create_wide_backpatch (uint64_t bits);
 
     /* write all constants and patch with their relative addresses */
     void patch_constants (std::vector<Instruction> &code);
@@ -85,6 +190,9 @@ protected:
     /* write setup instructions for locals */
     void write_locals (std::vector<Instruction> &code);
 
+    /* determine purity and inputs of the finished code */
+    void analyze ();
+
     bool is_finished;
 
     /* entry point or first instruction of the expression */
@@ -93,9 +201,23 @@ protected:
     unsigned num_locals;
     std::unordered_map<std::string, unsigned> locals;
 
+    /* kinds of the values on the stack while building, then the top one */
+    std::vector<ValueKind> kinds;
+    ValueKind result;
+
+    /* one inline cache per name instruction */
+    std::vector<NameCache> names;
+
     /* constants and their backpatches */
     std::unordered_map<int32_t, unsigned> constants;
     std::vector<std::pair<unsigned, unsigned>> constant_bp;
+    std::unordered_map<uint64_t, unsigned> wide_constants;
+    std::vector<std::pair<unsigned, uint64_t>> wide_bp;
 
     std::vector<Instruction> bytecode;
+
+    bool pure;
+    std::vector<Instruction> input_loads;
+    unsigned long memo_version;
+    std::map<std::vector<int32_t>, std::vector<int32_t>> memo;
 };
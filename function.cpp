@@ -0,0 +1,142 @@
+#include "function.hpp"
+#include "image.hpp"
+#include "parser.hpp"
+
+Function::Function (Expression *body, bool owns)
+    : refs(0)
+    , compiled(body)
+    , owned(owns)
+    , failed(false)
+    , from_source(false)
+    , env(nullptr)
+    , mapping(nullptr)
+    , offset(0)
+    , charged(0)
+{ }
+
+Function::Function (const std::string &source, Environment *env)
+    : refs(0)
+    , compiled(nullptr)
+    , owned(true)
+    , failed(false)
+    , from_source(true)
+    , text(source)
+    , env(env)
+    , mapping(nullptr)
+    , offset(0)
+    , charged(source.size())
+{ }
+
+Function::Function (ImageMapping *mapping, size_t offset)
+    : refs(0)
+    , compiled(nullptr)
+    , owned(true)
+    , failed(false)
+    , from_source(false)
+    , env(nullptr)
+    , mapping(Image::retain(mapping))
+    , offset(offset)
+    , charged(0)
+{ }
+
+Function::~Function ()
+{
+    if (env)
+        env->stubs.erase(this);
+    if (owned)
+        delete compiled;
+    Image::release(mapping);
+}
+
+Expression*
+Function::body ()
+{
+    if (compiled || failed)
+        return compiled;
+
+    if (mapping) {
+        compiled = Image::decode(mapping, offset);
+        failed = !compiled;
+        Image::release(mapping);
+        mapping = nullptr;
+        return compiled;
+    }
+
+    Compiler compiler(env);
+    compiled = compiler.compile(text.data(), text.data() + text.size());
+    diag = compiler.diagnostics();
+    if (compiled && env) {
+        if (env->charge(compiled->bytes())) {
+            charged += compiled->bytes();
+        } else {
+            diag.error("out of memory compiling the body\n");
+            delete compiled;
+            compiled = nullptr;
+        }
+    }
+    failed = !compiled;
+    if (compiled)
+        std::string().swap(text);
+    return compiled;
+}
+
+void
+Function::detach ()
+{
+    env = nullptr;
+    if (from_source && !compiled && !failed) {
+        diag.error("environment destroyed before the function was compiled\n");
+        failed = true;
+    }
+}
+
+bool
+Function::is_compiled () const
+{
+    return compiled != nullptr;
+}
+
+bool
+Function::is_stub () const
+{
+    return from_source && !compiled;
+}
+
+const std::string&
+Function::source () const
+{
+    return text;
+}
+
+Environment*
+Function::environment () const
+{
+    return env;
+}
+
+const Diagnostics&
+Function::diagnostics () const
+{
+    return diag;
+}
+
+unsigned long
+Function::bytes () const
+{
+    return sizeof(Function) + charged;
+}
+
+Function*
+Function::retain (Function *fn)
+{
+    if (fn)
+        fn->refs++;
+    return fn;
+}
+
+void
+Function::release (Function *fn)
+{
+    if (fn && --fn->refs == 0)
+        delete fn;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <string>
+#include "error.hpp"
+#include "expression.hpp"
+
+class Environment;
+struct ImageMapping;
+
+/*
+ * A Function is the body behind a FUNCTION symbol. It is either an already
+ * finished Expression, or a stub holding only the source of its body which
+ * is compiled the first time the body is asked for. The compiled body is
+ * kept so it is only ever compiled once. After compiling, the source is
+ * dropped, so a function which is never called costs only its source text.
+ * Functions restored from a mapped image are much the same, their bodies are
+ * decoded out of the mapping on first use rather than compiled.
+ *
+ * A stub is compiled against the Environment it was declared in, so its
+ * body may use the globals of that environment. A stub which fails to
+ * compile keeps its diagnostics and never tries again. Neither does a stub
+ * whose environment was destroyed before it was called, it then has no
+ * environment and fails with an error.
+ *
+ * A stub is charged to its environment for its source, and for its body once
+ * compiled. A body which would take the environment over a hard quota fails
+ * to compile.
+ *
+ * Functions are reference counted by the Symbols holding them. Like
+ * Strings the counts are not atomic. A Function deletes a body it compiled
+ * or decoded itself, but a body it was given only if it was told to own it.
+ */
+class Function {
+public:
+    /* a function whose body is already finished */
+    Function (Expression *body, bool owns = false);
+
+    /* a stub compiled from source on first use */
+    Function (const std::string &source, Environment *env);
+
+    /* a body decoded from the record at offset in a mapped image on use */
+    Function (ImageMapping *mapping, size_t offset);
+
+    Function (const Function &other) = delete;
+    Function& operator= (const Function &other) = delete;
+    ~Function ();
+
+    /* the finished body, compiling it if needed. NULL if it can't compile */
+    Expression* body ();
+
+    /* true once the body exists */
+    bool is_compiled () const;
+
+    /* true for a stub which has yet to be compiled from its source */
+    bool is_stub () const;
+
+    /* source of a stub, empty once compiled */
+    const std::string& source () const;
+
+    /* the environment a stub is compiled against */
+    Environment* environment () const;
+
+    /* errors from compiling the stub */
+    const Diagnostics& diagnostics () const;
+
+    /* bytes charged for the function, its source and any body it compiled */
+    unsigned long bytes () const;
+
+    static Function* retain (Function *fn);
+    static void release (Function *fn);
+
+protected:
+    friend class Image;
+    friend class Environment;
+
+    /* forget the environment as it is destroyed, failing if still a stub */
+    void detach ();
+
+    unsigned refs;
+    Expression *compiled;
+    bool owned;
+    bool failed;
+    bool from_source;
+    std::string text;
+    Environment *env;
+    ImageMapping *mapping;
+    size_t offset;
+    unsigned long charged;
+    Diagnostics diag;
+};
@@ -0,0 +1,669 @@
+#include <algorithm>
+#include <string.h>
+#include <fstream>
+#include <unordered_map>
+#include "error.hpp"
+#include "source.hpp"
+#include "image.hpp"
+
+/*
+ * The Image Format:
+ *
+ * +-------------------+
+ * |       Header      |  magic, version, #expressions, #symbols, #envs
+ * +-------------------+
+ * |    Expressions    |  entry, result kind, #locals, locals, #names, names,
+ * |                   |  #words, code
+ * +-------------------+
+ * |      Symbols      |  type, #bytes, payload
+ * +-------------------+
+ * |    Environments   |  parent, soft quota, hard quota, constants,
+ * |                   |  locals, symbol table
+ * +-------------------+
+ *
+ * Everything is written as 32bit words. Payloads and strings are padded out
+ * to the next word. References and functions hold the index of the symbol or
+ * expression they point to rather than an address. Environments are written
+ * parent first so each environment's parent has been restored before it.
+ * Quotas are 64bit, written low word first. A restored environment is held
+ * to its quotas, an image which doesn't fit under them isn't restored.
+ *
+ * A string's payload starts with a word which is 1 if the string is interned
+ * and 0 otherwise, so string constants are interned again when restored. A
+ * chunk's payload starts with the stride of its records.
+ *
+ * A function which has never been called is written as a stub: IMAGE_STUB,
+ * the index of its environment, then its source. It stays uncompiled until
+ * it is first called after being restored.
+ *
+ * A mapped image is only walked once when loaded, checking every length.
+ * The expression records are stepped over and decoded the first time their
+ * function is called, straight out of the mapping.
+ */
+
+#define IMAGE_MAGIC   0x49545052 /* "RPTI" */
+#define IMAGE_VERSION 7
+#define IMAGE_NONE    0xFFFFFFFF
+#define IMAGE_STUB    0xFFFFFFFE
+
+typedef std::vector<uint32_t> Words;
+
+static void
+write_bytes (Words &out, const Byte *bytes, uint32_t len)
+{
+    size_t start = out.size();
+    out.push_back(len);
+    out.resize(start + 1 + (len + 3) / 4, 0);
+    memcpy(&out[start + 1], bytes, len);
+}
+
+static void
+write_string (Words &out, const std::string &str)
+{
+    write_bytes(out, (const Byte*) str.data(), str.size());
+}
+
+static void
+write_quota (Words &out, unsigned long quota)
+{
+    out.push_back((uint32_t) quota);
+    out.push_back((uint32_t) ((uint64_t) quota >> 32));
+}
+
+/*
+ * Reads words from an image making sure never to read past its end. Once a
+ * read fails every following read fails too so only the final state needs
+ * checking.
+ */
+struct Reader {
+    Reader (const Byte *image, size_t length)
+        : image(image), length(length), offset(0), ok(true)
+    { }
+
+    uint64_t
+    quota ()
+    {
+        uint64_t low = word();
+        return low | (uint64_t) word() << 32;
+    }
+
+    uint32_t
+    word ()
+    {
+        uint32_t w = 0;
+        if (!ok || offset + 4 > length) {
+            ok = false;
+            return 0;
+        }
+        memcpy(&w, image + offset, 4);
+        offset += 4;
+        return w;
+    }
+
+    const Byte*
+    words (uint32_t count)
+    {
+        return skip((size_t) count * 4);
+    }
+
+    const Byte*
+    bytes (uint32_t &len)
+    {
+        len = word();
+        return skip(((size_t) len + 3) & ~(size_t) 3);
+    }
+
+    const Byte*
+    skip (size_t padded)
+    {
+        if (!ok || offset + padded > length) {
+            ok = false;
+            return nullptr;
+        }
+        const Byte *start = image + offset;
+        offset += padded;
+        return start;
+    }
+
+    std::string
+    string ()
+    {
+        uint32_t len;
+        const Byte *start = bytes(len);
+        return ok ? std::string((const char*) start, len) : std::string();
+    }
+
+    const Byte *image;
+    size_t length;
+    size_t offset;
+    bool ok;
+};
+
+std::vector<Byte>
+Image::snapshot (const Environment &env)
+{
+    std::vector<const Environment*> envs;
+    std::vector<Symbol*> syms;
+    std::vector<Expression*> exprs;
+    std::unordered_map<const Symbol*, uint32_t> sym_index;
+    std::unordered_map<const Expression*, uint32_t> expr_index;
+
+    /* environments in breadth-first order so parents precede children */
+    envs.push_back(&env);
+    for (unsigned i = 0; i < envs.size(); i++)
+        for (auto child : envs[i]->children)
+            envs.push_back(child);
+
+    auto add_symbol = [&] (Symbol *sym) {
+        if (sym && sym_index.find(sym) == sym_index.end()) {
+            sym_index[sym] = syms.size();
+            syms.push_back(sym);
+        }
+    };
+
+    for (auto e : envs) {
+        for (auto sym : e->constant_pool) add_symbol(sym);
+        for (auto sym : e->local_pool)    add_symbol(sym);
+        for (auto &p : e->symbol_table)   add_symbol(p.second);
+    }
+
+    /* 
+     * Follow references and functions. The list of symbols grows while
+     * walking it so anything reachable from a reference is included.
+     */
+    for (unsigned i = 0; i < syms.size(); i++) {
+        if (syms[i]->type() == REFERENCE) {
+            add_symbol(syms[i]->ref());
+        } else if (syms[i]->type() == FUNCTION) {
+            Function *fn = syms[i]->function();
+            if (!fn || fn->is_stub())
+                continue;
+            Expression *expr = fn->body();
+            if (expr && expr_index.find(expr) == expr_index.end()) {
+                expr_index[expr] = exprs.size();
+                exprs.push_back(expr);
+            }
+        }
+    }
+
+    Words out;
+    out.push_back(IMAGE_MAGIC);
+    out.push_back(IMAGE_VERSION);
+    out.push_back(exprs.size());
+    out.push_back(syms.size());
+    out.push_back(envs.size());
+
+    for (auto expr : exprs) {
+        assert(expr->is_finished);
+        out.push_back(expr->entry_index);
+        out.push_back(expr->result);
+        out.push_back(expr->locals.size());
+        for (auto &p : expr->locals) {
+            write_string(out, p.first);
+            out.push_back(p.second);
+        }
+        out.push_back(expr->names.size());
+        for (auto &cache : expr->names)
+            write_string(out, cache.name);
+        out.push_back(expr->bytecode.size());
+        out.insert(out.end(), expr->bytecode.begin(), expr->bytecode.end());
+    }
+
+    for (auto sym : syms) {
+        uint32_t target;
+        out.push_back(sym->type());
+        switch (sym->type()) {
+            case REFERENCE:
+                target = sym->ref() ? sym_index[sym->ref()] : IMAGE_NONE;
+                write_bytes(out, (const Byte*) &target, sizeof(target));
+                break;
+
+            case FUNCTION: {
+                Function *fn = sym->function();
+                if (fn && fn->is_stub()) {
+                    auto pos = std::find(envs.begin(), envs.end(), fn->env);
+                    uint32_t stub[2] = { IMAGE_STUB, pos == envs.end()
+                                         ? IMAGE_NONE : uint32_t(pos - envs.begin()) };
+                    std::string payload((const char*) stub, sizeof(stub));
+                    payload += fn->source();
+                    write_string(out, payload);
+                    break;
+                }
+                target = fn && fn->body() ? expr_index[fn->body()] : IMAGE_NONE;
+                write_bytes(out, (const Byte*) &target, sizeof(target));
+                break;
+            }
+
+            case STRING: {
+                String str = sym->string();
+                uint32_t interned = str.is_interned();
+                std::string payload((const char*) &interned, sizeof(interned));
+                payload += str.str();
+                write_string(out, payload);
+                break;
+            }
+
+            case CHUNK: {
+                uint32_t stride = sym->record_stride();
+                std::string payload((const char*) &stride, sizeof(stride));
+                payload.append((const char*) sym->data(), sym->bytes());
+                write_string(out, payload);
+                break;
+            }
+
+            default:
+                write_bytes(out, sym->data(), sym->bytes());
+                break;
+        }
+    }
+
+    std::unordered_map<const Environment*, uint32_t> env_index;
+    for (auto e : envs) {
+        uint32_t index = env_index.size();
+        env_index[e] = index;
+        out.push_back(e->parent && env_index.count(e->parent)
+                      ? env_index[e->parent] : IMAGE_NONE);
+        write_quota(out, e->soft);
+        write_quota(out, e->hard);
+
+        out.push_back(e->constant_pool.size());
+        for (auto sym : e->constant_pool)
+            out.push_back(sym_index[sym]);
+
+        out.push_back(e->local_pool.size());
+        for (auto sym : e->local_pool)
+            out.push_back(sym_index[sym]);
+
+        out.push_back(e->symbol_table.size());
+        for (auto &p : e->symbol_table) {
+            write_string(out, p.first);
+            out.push_back(sym_index[p.second]);
+        }
+    }
+
+    std::vector<Byte> image(out.size() * sizeof(uint32_t));
+    memcpy(image.data(), out.data(), image.size());
+    return image;
+}
+
+/* step over an expression record without decoding it */
+static void
+skip_expression (Reader &in)
+{
+    in.word();
+    if (in.word() > VALUE_DOUBLE)
+        in.ok = false;
+    uint32_t num_locals = in.word();
+    for (uint32_t j = 0; j < num_locals && in.ok; j++) {
+        uint32_t len;
+        in.bytes(len);
+        in.word();
+    }
+    uint32_t num_names = in.word();
+    for (uint32_t j = 0; j < num_names && in.ok; j++) {
+        uint32_t len;
+        in.bytes(len);
+    }
+    in.words(in.word());
+}
+
+Expression*
+Image::read_expression (const Byte *image, size_t length, size_t &offset)
+{
+    Reader in(image, length);
+    in.offset = offset;
+
+    Expression *expr = new Expression();
+    expr->entry_index = in.word();
+    uint32_t kind = in.word();
+    if (kind > VALUE_DOUBLE)
+        in.ok = false;
+    expr->result = (ValueKind) kind;
+
+    uint32_t num_locals = in.word();
+    for (uint32_t j = 0; j < num_locals && in.ok; j++) {
+        std::string name = in.string();
+        expr->locals[name] = in.word();
+    }
+    expr->num_locals = expr->locals.size();
+
+    uint32_t num_names = in.word();
+    for (uint32_t j = 0; j < num_names && in.ok; j++) {
+        NameCache cache = { in.string(), nullptr, 0 };
+        expr->names.push_back(cache);
+    }
+
+    uint32_t len = in.word();
+    const Byte *code = in.words(len);
+    if (!in.ok) {
+        delete expr;
+        return nullptr;
+    }
+    expr->bytecode.resize(len);
+    memcpy(expr->bytecode.data(), code, (size_t) len * 4);
+    expr->is_finished = true;
+    expr->analyze();
+
+    offset = in.offset;
+    return expr;
+}
+
+Expression*
+Image::decode (ImageMapping *mapping, size_t offset)
+{
+    return read_expression((const Byte*) mapping->source.begin(),
+                           mapping->source.size(), offset);
+}
+
+ImageMapping*
+Image::retain (ImageMapping *mapping)
+{
+    if (mapping)
+        mapping->refs++;
+    return mapping;
+}
+
+void
+Image::release (ImageMapping *mapping)
+{
+    if (mapping && --mapping->refs == 0)
+        delete mapping;
+}
+
+Environment*
+Image::restore (const Byte *image, size_t length, Diagnostics &diag)
+{
+    return restore(image, length, nullptr, diag);
+}
+
+Environment*
+Image::restore (const Byte *image, size_t length, ImageMapping *mapping,
+                Diagnostics &diag)
+{
+    Reader in(image, length);
+
+    if (in.word() != IMAGE_MAGIC || in.word() != IMAGE_VERSION) {
+        diag.error("image: bad magic or version\n");
+        return nullptr;
+    }
+
+    uint32_t num_exprs = in.word();
+    uint32_t num_syms = in.word();
+    uint32_t num_envs = in.word();
+
+    /*
+     * Every body belongs to a Function. They're held here until the symbols
+     * have taken their own references, so whatever isn't taken is freed.
+     */
+    std::vector<Function*> fns;
+    for (uint32_t i = 0; i < num_exprs && in.ok; i++) {
+        Function *fn;
+        if (mapping) {
+            fn = new Function(mapping, in.offset);
+            skip_expression(in);
+        } else {
+            Expression *expr = read_expression(image, length, in.offset);
+            if (!expr) {
+                in.ok = false;
+                break;
+            }
+            fn = new Function(expr, true);
+        }
+        fns.push_back(Function::retain(fn));
+    }
+
+    /* references may point forward so they're fixed up after the fact */
+    std::vector<Symbol*> syms;
+    std::vector<std::pair<Symbol*, uint32_t>> fixups;
+    std::vector<std::pair<Function*, uint32_t>> stubs;
+    for (uint32_t i = 0; i < num_syms && in.ok; i++) {
+        SymbolType type = (SymbolType) in.word();
+        uint32_t len, target = IMAGE_NONE;
+        const Byte *payload = in.bytes(len);
+        if (!in.ok)
+            break;
+
+        if (type == REFERENCE || type == FUNCTION) {
+            if (len < sizeof(target)) {
+                in.ok = false;
+                break;
+            }
+            memcpy(&target, payload, sizeof(target));
+            bool stub = type == FUNCTION && target == IMAGE_STUB;
+            if (stub ? len < 2 * sizeof(target) : len != sizeof(target)) {
+                in.ok = false;
+                break;
+            }
+        }
+
+        Symbol *sym = nullptr;
+        switch (type) {
+            case INTEGER:
+                sym = Symbol(0).allocate();
+                break;
+
+            case DOUBLE:
+                sym = Symbol(0.0).allocate();
+                break;
+
+            case CHUNK: {
+                uint32_t stride;
+                if (len < sizeof(stride)) {
+                    in.ok = false;
+                    break;
+                }
+                memcpy(&stride, payload, sizeof(stride));
+                payload += sizeof(stride);
+                len -= sizeof(stride);
+                sym = Symbol(len, stride).allocate();
+                break;
+            }
+
+            case STRING: {
+                uint32_t interned;
+                if (len < sizeof(interned)) {
+                    in.ok = false;
+                    break;
+                }
+                memcpy(&interned, payload, sizeof(interned));
+                std::string str((const char*) payload + sizeof(interned),
+                                len - sizeof(interned));
+                sym = Symbol(interned ? String::intern(str) : String(str))
+                      .allocate();
+                break;
+            }
+
+            case REFERENCE:
+                sym = Symbol((Symbol*) nullptr).allocate();
+                fixups.push_back(std::make_pair(sym, target));
+                break;
+
+            case FUNCTION:
+                if (target == IMAGE_STUB) {
+                    uint32_t env;
+                    memcpy(&env, payload + sizeof(target), sizeof(env));
+                    std::string source((const char*) payload + 2 * sizeof(env),
+                                       len - 2 * sizeof(env));
+                    Function *fn = new Function(source, nullptr);
+                    stubs.push_back(std::make_pair(fn, env));
+                    sym = Symbol(fn).allocate();
+                    break;
+                }
+                if (target != IMAGE_NONE && target >= fns.size()) {
+                    in.ok = false;
+                    break;
+                }
+                sym = Symbol(target == IMAGE_NONE
+                             ? (Function*) nullptr : fns[target]).allocate();
+                break;
+
+            default:
+                in.ok = false;
+                break;
+        }
+
+        if (!sym)
+            break;
+        if (type == INTEGER || type == DOUBLE || type == CHUNK) {
+            if (sym->bytes() != len) {
+                delete sym;
+                in.ok = false;
+                break;
+            }
+            memcpy(sym->data(), payload, len);
+        }
+        syms.push_back(sym);
+    }
+
+    for (auto &p : fixups) {
+        if (p.second == IMAGE_NONE)
+            continue;
+        if (p.second >= syms.size()) {
+            in.ok = false;
+            break;
+        }
+        p.first->set(0, (void*) syms[p.second]);
+    }
+
+    auto symbol_at = [&] (uint32_t index) -> Symbol* {
+        if (index >= syms.size()) {
+            in.ok = false;
+            return nullptr;
+        }
+        return syms[index];
+    };
+
+    std::vector<Environment*> envs;
+    std::vector<uint32_t> parents;
+    bool over = false;
+    for (uint32_t i = 0; i < num_envs && in.ok; i++) {
+        uint32_t parent = in.word();
+        uint64_t soft = in.quota();
+        uint64_t hard = in.quota();
+        Environment *env;
+        if (parent == IMAGE_NONE && envs.empty())
+            env = new Environment();
+        else if (parent < envs.size())
+            env = envs[parent]->add_child();
+        else
+            break;
+        if (!env) {
+            over = true;
+            break;
+        }
+        env->set_quota(soft, hard);
+        envs.push_back(env);
+        parents.push_back(parent);
+
+        uint32_t count = in.word();
+        for (uint32_t j = 0; j < count && in.ok; j++)
+            env->constant_pool.push_back(symbol_at(in.word()));
+
+        count = in.word();
+        for (uint32_t j = 0; j < count && in.ok; j++)
+            env->local_pool.push_back(symbol_at(in.word()));
+
+        count = in.word();
+        for (uint32_t j = 0; j < count && in.ok; j++) {
+            std::string name = in.string();
+            env->symbol_table[name] = symbol_at(in.word());
+        }
+        env->index_locals();
+    }
+
+    /* stubs compile against their environment once they're called */
+    for (auto &p : stubs) {
+        if (p.second == IMAGE_NONE)
+            continue;
+        if (p.second >= envs.size()) {
+            in.ok = false;
+            break;
+        }
+        p.first->env = envs[p.second];
+        envs[p.second]->stubs.insert(p.first);
+    }
+
+    /*
+     * Symbols are charged to the first environment holding them, which has
+     * to fit under the quotas of the environment and all of its parents.
+     * Children come after their parents so summing backwards gives each
+     * environment the total of its children before its own parent needs it.
+     */
+    std::vector<unsigned long> charges(envs.size(), 0);
+    if (in.ok && !over && !envs.empty()) {
+        std::unordered_map<const Symbol*, uint32_t> holder;
+        for (uint32_t i = 0; i < envs.size(); i++) {
+            for (auto sym : envs[i]->constant_pool) holder.emplace(sym, i);
+            for (auto sym : envs[i]->local_pool)    holder.emplace(sym, i);
+            for (auto &p : envs[i]->symbol_table)   holder.emplace(p.second, i);
+        }
+        /* a function goes to the first environment holding any symbol of it */
+        std::unordered_map<const Function*, uint32_t> fn_holder;
+        for (auto sym : syms) {
+            auto it = holder.find(sym);
+            uint32_t i = it == holder.end() ? 0 : it->second;
+            charges[i] += Environment::footprint(sym);
+            if (sym->type() == FUNCTION && sym->function()) {
+                auto fn = fn_holder.emplace(sym->function(), i).first;
+                fn->second = std::min(fn->second, i);
+            }
+        }
+        for (auto &p : fn_holder)
+            charges[p.second] += p.first->bytes();
+        for (size_t i = envs.size(); i-- > 1; )
+            charges[parents[i]] += charges[i];
+        for (size_t i = 0; i < envs.size(); i++)
+            if (envs[i]->hard && envs[i]->used + charges[i] > envs[i]->hard)
+                over = true;
+    }
+
+    if (over || !in.ok || envs.size() != num_envs || envs.empty()) {
+        diag.error(over ? "image: over its hard quota\n"
+                        : "image: truncated or malformed image\n");
+        /* nothing has been taken or charged yet so it can all just go */
+        if (!envs.empty())
+            delete envs[0];
+        for (auto sym : syms)
+            delete sym;
+        for (auto fn : fns)
+            Function::release(fn);
+        return nullptr;
+    }
+
+    for (auto sym : syms)
+        Environment::symbols.push_back(sym);
+
+    /* symbols are charged to the first environment holding them */
+    for (auto env : envs) {
+        for (auto sym : env->constant_pool) if (sym) env->adopt(sym);
+        for (auto sym : env->local_pool)    if (sym) env->adopt(sym);
+        for (auto &p : env->symbol_table)   if (p.second) env->adopt(p.second);
+    }
+    for (auto sym : syms)
+        envs[0]->adopt(sym);
+
+    for (auto fn : fns)
+        Function::release(fn);
+    return envs[0];
+}
+
+bool
+Image::save (const std::string &path, const Environment &env)
+{
+    std::vector<Byte> image = snapshot(env);
+    std::ofstream file(path, std::ios::binary);
+    file.write((const char*) image.data(), image.size());
+    return file.good();
+}
+
+Environment*
+Image::load (const std::string &path, Diagnostics &diag)
+{
+    ImageMapping *mapping = retain(new ImageMapping(path, diag));
+    Environment *env = nullptr;
+    if (mapping->source.ok())
+        env = restore((const Byte*) mapping->source.begin(),
+                      mapping->source.size(), mapping, diag);
+    release(mapping);
+    return env;
+}
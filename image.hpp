@@ -0,0 +1,69 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "environment.hpp"
+#include "source.hpp"
+
+/*
+ * An image file mapped by Image::load. Functions restored from it decode
+ * their bodies straight out of the mapping when first called, so it stays
+ * mapped until the last of them has been.
+ */
+struct ImageMapping {
+    ImageMapping (const std::string &path, Diagnostics &diag)
+        : source(path, diag), refs(0)
+    { }
+
+    Source source;
+    unsigned refs;
+};
+
+/*
+ * An Image is a snapshot of a fully populated Environment (and all of its
+ * children) including every Symbol it can reach and the compiled Expressions
+ * of its functions. Images contain no pointers, every reference is an index
+ * into a table within the image itself, so an image can be written out by one
+ * process and mapped anywhere by another without registering each symbol all
+ * over again.
+ *
+ * Restored functions, and their bodies, are owned by the restored symbols and
+ * freed along with them. A malformed image leaves nothing behind.
+ */
+class Image {
+public:
+    /* Serialize the environment into a relocatable image */
+    static std::vector<Byte> snapshot (const Environment &env);
+
+    /* Rebuild an environment from an image. Returns NULL if malformed */
+    static Environment* restore (const Byte *image, size_t length,
+                                 Diagnostics &diag);
+
+    /* Write an image of the environment to the file at path */
+    static bool save (const std::string &path, const Environment &env);
+
+    /*
+     * Map the image at path and restore the environment within it. Function
+     * bodies are not decoded until they are called, but every symbol and
+     * environment is still copied out of the mapping as it's loaded. Returns
+     * NULL and reports to diag if the file can't be mapped or is malformed.
+     */
+    static Environment* load (const std::string &path, Diagnostics &diag);
+
+protected:
+    friend class Function;
+
+    /* decode the expression record at offset in the mapping, NULL if bad */
+    static Expression* decode (ImageMapping *mapping, size_t offset);
+
+    static ImageMapping* retain (ImageMapping *mapping);
+    static void release (ImageMapping *mapping);
+
+    /* read the expression record at offset, moving offset past it */
+    static Expression* read_expression (const Byte *image, size_t length,
+                                        size_t &offset);
+
+    /* restore, decoding bodies lazily out of mapping if given */
+    static Environment* restore (const Byte *image, size_t length,
+                                 ImageMapping *mapping, Diagnostics &diag);
+};
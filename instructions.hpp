@@ -7,6 +7,8 @@
  *
  * +-------------------+
  * |     Constants     |
+ * +-------------------+
+ * |   Wide Constants  |
  * +-------------------+ <---- Entry Point
  * |    Local Setup    |
  * +-------------------+
@@ -23,6 +25,10 @@
  * be "chained" or otherwise joined with any other expression easily. Relative
  * addressing includes the "push constant" instruction as well as function
  * calls.
+ *
+ * Wide (64bit) constants follow the regular constants. Each takes two words,
+ * low word first, and starts on an even word so it can be read with a single
+ * aligned 8 byte load.
  */
 
 typedef uint32_t Instruction;
@@ -51,4 +57,28 @@ enum InsOpcode {
     OP_SUBF   = 0x12, /* pop n values off stack, subtract them, and push result */
     OP_DIVF   = 0x13, /* pop n values off stack, divide them, and push result */
     OP_MULF   = 0x14, /* pop n values off stack, multiply them, and push result */
+
+    OP_LOADG  = 0x15, /* push session global's value onto stack */
+    OP_STOREG = 0x16, /* store top of stack into session global */
+
+    /*
+     * Wide values are 64bit integers (L) or doubles (D). On the stack they
+     * take two slots, the low word below the high word.
+     */
+    OP_PUSHW  = 0x17, /* push wide constant at constant index onto stack */
+    OP_ADDL   = 0x18, /* pop 2 wide values, add them, and push result */
+    OP_SUBL   = 0x19, /* pop 2 wide values, subtract them, and push result */
+    OP_DIVL   = 0x1a, /* pop 2 wide values, divide them, and push result */
+    OP_MULL   = 0x1b, /* pop 2 wide values, multiply them, and push result */
+    OP_ADDD   = 0x1c, /* pop 2 wide values, add them, and push result */
+    OP_SUBD   = 0x1d, /* pop 2 wide values, subtract them, and push result */
+    OP_DIVD   = 0x1e, /* pop 2 wide values, divide them, and push result */
+    OP_MULD   = 0x1f, /* pop 2 wide values, multiply them, and push result */
+
+    /*
+     * Names are resolved through the bound Environment and its parents. The
+     * immediate is the index of the instruction's name cache.
+     */
+    OP_LOADN  = 0x20, /* push the value bound to the name onto stack */
+    OP_STOREN = 0x21, /* store top of stack into the value bound to the name */
 };
@@ -0,0 +1,120 @@
+#include <assert.h>
+#include "layout.hpp"
+
+/* round n up to the next multiple of align (always a power of two) */
+static unsigned
+align_up (unsigned n, unsigned align)
+{
+    return (n + align - 1) & ~(align - 1);
+}
+
+Layout::Layout ()
+    : record_size(0), record_align(1), total_width(0)
+{ }
+
+unsigned
+Layout::type_size (FieldType type)
+{
+    switch (type) {
+        case FIELD_BYTE:   return 1;
+        case FIELD_INT:    return sizeof(int);
+        case FIELD_DOUBLE: return sizeof(double);
+        case FIELD_PTR:    return sizeof(void*);
+    }
+    assert(false);
+    return 0;
+}
+
+unsigned
+Layout::add (FieldType type, unsigned count)
+{
+    assert(count > 0);
+    unsigned size = type_size(type);
+    unsigned end = 0;
+    Field field;
+
+    /* the end of the last field, not the padded size of the record */
+    if (!field_list.empty()) {
+        const Field &last = field_list.back();
+        end = last.offset + type_size(last.type) * last.count;
+    }
+
+    field.type = type;
+    field.count = count;
+    field.offset = align_up(end, size);
+    field.width = size * count;
+    field.column = total_width;
+    field_list.push_back(field);
+    total_width += field.width;
+
+    if (size > record_align)
+        record_align = size;
+    record_size = align_up(field.offset + size * count, record_align);
+
+    return field_list.size() - 1;
+}
+
+unsigned
+Layout::size () const
+{
+    return record_size;
+}
+
+unsigned
+Layout::align () const
+{
+    return record_align;
+}
+
+unsigned
+Layout::fields () const
+{
+    return field_list.size();
+}
+
+unsigned
+Layout::offset (unsigned field, unsigned elem) const
+{
+    assert(field < field_list.size());
+    assert(elem < field_list[field].count);
+    return field_list[field].offset + elem * type_size(field_list[field].type);
+}
+
+/*
+ * Every element size divides the record alignment, so with a multiple of it
+ * in records every column's length is a multiple of every alignment too.
+ */
+unsigned
+Layout::column_records (unsigned records) const
+{
+    return align_up(records, record_align);
+}
+
+unsigned
+Layout::column (unsigned field, unsigned records) const
+{
+    assert(field < field_list.size());
+    return field_list[field].column * column_records(records);
+}
+
+unsigned
+Layout::bytes (unsigned records, LayoutMode mode) const
+{
+    if (mode == LAYOUT_AOS)
+        return record_size * records;
+    return total_width * column_records(records);
+}
+
+unsigned
+Layout::offset (unsigned record, unsigned field, unsigned elem,
+                unsigned records, LayoutMode mode) const
+{
+    assert(record < records);
+    if (mode == LAYOUT_AOS)
+        return record * record_size + offset(field, elem);
+
+    /* within a column each record's elements sit next to each other */
+    const Field &f = field_list[field];
+    assert(elem < f.count);
+    return column(field, records) + record * f.width + elem * type_size(f.type);
+}
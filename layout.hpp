@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vector>
+
+/*
+ * A Layout describes the structure type held by a CHUNK symbol, e.g.
+ * { int, void*, int[10] }. Fields are added in order and each is placed at
+ * the next offset aligned for its type, with the record padded out to the
+ * alignment of its largest field, exactly as a C compiler would. Offsets are
+ * computed once when the layout is built so every access afterwards is just
+ * arithmetic on known numbers.
+ *
+ * An array of records can be stored either as an array of structures (each
+ * record contiguous) or as a structure of arrays where every field gets its
+ * own contiguous column. The latter is what you want when scanning a single
+ * field over many records. Every column holds a whole multiple of the record
+ * alignment in records, so each column starts aligned without any padding
+ * between them and a column's start is one multiplication away.
+ */
+
+typedef enum _FieldType {
+    FIELD_BYTE,
+    FIELD_INT,
+    FIELD_DOUBLE,
+    FIELD_PTR
+} FieldType;
+
+typedef enum _LayoutMode {
+    LAYOUT_AOS,  /* array of structures */
+    LAYOUT_SOA   /* structure of arrays */
+} LayoutMode;
+
+struct Field {
+    FieldType type;
+    unsigned count;   /* number of elements, 1 for scalars */
+    unsigned offset;  /* byte offset within a single record */
+    unsigned width;   /* bytes of one record's elements */
+    unsigned column;  /* total width of the fields before it */
+};
+
+class Layout {
+public:
+    Layout ();
+
+    /* append a field (or an array of count elements) and return its index */
+    unsigned add (FieldType type, unsigned count = 1);
+
+    /* size of a single record including its trailing padding */
+    unsigned size () const;
+
+    /* alignment of the record, the largest alignment of any field */
+    unsigned align () const;
+
+    /* number of fields */
+    unsigned fields () const;
+
+    /* byte offset of an element of a field within a single record */
+    unsigned offset (unsigned field, unsigned elem = 0) const;
+
+    /* bytes needed to store the given number of records */
+    unsigned bytes (unsigned records, LayoutMode mode) const;
+
+    /* 
+     * Byte offset of an element of a field of a record within a chunk of
+     * `records` records stored in the given mode.
+     */
+    unsigned offset (unsigned record, unsigned field, unsigned elem,
+                     unsigned records, LayoutMode mode) const;
+
+    /* size and alignment of a single element of a type */
+    static unsigned type_size (FieldType type);
+
+protected:
+    /* start of a field's column when stored as a structure of arrays */
+    unsigned column (unsigned field, unsigned records) const;
+
+    /* records held by each column, rounded up to the record alignment */
+    unsigned column_records (unsigned records) const;
+
+    std::vector<Field> field_list;
+    unsigned record_size;
+    unsigned record_align;
+    unsigned total_width;  /* width of every field, no padding */
+};
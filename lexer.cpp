@@ -0,0 +1,274 @@
+#include <string.h>
+#include "lexer.hpp"
+
+#if defined(__SSE2__)
+#define LEXER_SSE2 true
+#include <emmintrin.h>
+#endif
+
+std::string
+Token::text () const
+{
+    return std::string(start, length);
+}
+
+bool
+Token::is (const char *str) const
+{
+    return strlen(str) == length && memcmp(start, str, length) == 0;
+}
+
+static inline bool
+is_space (char c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static inline bool
+is_digit (char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static inline bool
+is_ident (char c)
+{
+    char lower = c | 0x20;
+    return (lower >= 'a' && lower <= 'z') || is_digit(c) || c == '_';
+}
+
+#ifdef LEXER_SSE2
+
+/*
+ * Each of the SSE2 scanners loads 16 bytes, builds a mask of the bytes which
+ * belong to the run being scanned, and stops at the first byte which doesn't.
+ * Comparisons on bytes are signed so anything >= 0x80 is never in a range.
+ */
+
+static inline __m128i
+in_range (__m128i c, char lo, char hi)
+{
+    return _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8(lo - 1)),
+                         _mm_cmplt_epi8(c, _mm_set1_epi8(hi + 1)));
+}
+
+static inline __m128i
+space_mask (__m128i c)
+{
+    return _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8(' ')),
+                        in_range(c, '\t', '\r'));
+}
+
+static inline __m128i
+digit_mask (__m128i c)
+{
+    return in_range(c, '0', '9');
+}
+
+static inline __m128i
+ident_mask (__m128i c)
+{
+    __m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+    return _mm_or_si128(_mm_or_si128(in_range(lower, 'a', 'z'), digit_mask(c)),
+                        _mm_cmpeq_epi8(c, _mm_set1_epi8('_')));
+}
+
+#endif
+
+/*
+ * The scanners below take whole blocks of 16 bytes with SSE2 while simd is
+ * set, and the rest of the input a byte at a time. The bytewise loops are the
+ * reference the blocks have to agree with.
+ */
+
+static const char*
+skip_spaces (const char *p, const char *end, unsigned &line, bool simd)
+{
+#ifdef LEXER_SSE2
+    const __m128i nl = _mm_set1_epi8('\n');
+    while (simd && p + 16 <= end) {
+        __m128i c = _mm_loadu_si128((const __m128i*) p);
+        unsigned run = ~_mm_movemask_epi8(space_mask(c)) & 0xFFFF;
+        unsigned newlines = _mm_movemask_epi8(_mm_cmpeq_epi8(c, nl));
+        if (run) {
+            unsigned n = __builtin_ctz(run);
+            line += __builtin_popcount(newlines & ((1u << n) - 1));
+            return p + n;
+        }
+        line += __builtin_popcount(newlines);
+        p += 16;
+    }
+#endif
+    for (; p < end && is_space(*p); p++)
+        line += *p == '\n';
+    return p;
+}
+
+static const char*
+skip_digits (const char *p, const char *end, bool simd)
+{
+#ifdef LEXER_SSE2
+    while (simd && p + 16 <= end) {
+        __m128i c = _mm_loadu_si128((const __m128i*) p);
+        unsigned run = ~_mm_movemask_epi8(digit_mask(c)) & 0xFFFF;
+        if (run)
+            return p + __builtin_ctz(run);
+        p += 16;
+    }
+#endif
+    for (; p < end && is_digit(*p); p++)
+        ;
+    return p;
+}
+
+static const char*
+skip_ident (const char *p, const char *end, bool simd)
+{
+#ifdef LEXER_SSE2
+    while (simd && p + 16 <= end) {
+        __m128i c = _mm_loadu_si128((const __m128i*) p);
+        unsigned run = ~_mm_movemask_epi8(ident_mask(c)) & 0xFFFF;
+        if (run)
+            return p + __builtin_ctz(run);
+        p += 16;
+    }
+#endif
+    for (; p < end && is_ident(*p); p++)
+        ;
+    return p;
+}
+
+/*
+ * Find the '*' of the closing "*" "/" of a comment. NULL if there is none,
+ * every newline up to the end of the input has then been counted.
+ */
+static const char*
+find_comment_end (const char *p, const char *end, unsigned &line, bool simd)
+{
+#ifdef LEXER_SSE2
+    const __m128i star = _mm_set1_epi8('*');
+    const __m128i nl = _mm_set1_epi8('\n');
+    while (simd && p + 16 <= end) {
+        __m128i c = _mm_loadu_si128((const __m128i*) p);
+        unsigned stars = _mm_movemask_epi8(_mm_cmpeq_epi8(c, star));
+        unsigned newlines = _mm_movemask_epi8(_mm_cmpeq_epi8(c, nl));
+        while (stars) {
+            unsigned n = __builtin_ctz(stars);
+            if (p + n + 1 < end && p[n + 1] == '/') {
+                line += __builtin_popcount(newlines & ((1u << n) - 1));
+                return p + n;
+            }
+            stars &= stars - 1;
+        }
+        line += __builtin_popcount(newlines);
+        p += 16;
+    }
+#endif
+    for (; p < end; p++) {
+        if (p[0] == '*' && p + 1 < end && p[1] == '/')
+            return p;
+        line += *p == '\n';
+    }
+    return nullptr;
+}
+
+Lexer::Lexer (const char *begin, const char *end, unsigned line)
+    : p(begin), end(end), line(line), simd(true)
+{ }
+
+const char*
+Lexer::position () const
+{
+    return p;
+}
+
+bool
+Lexer::skip ()
+{
+    while (true) {
+        p = skip_spaces(p, end, line, simd);
+        if (p + 1 < end && p[0] == '/' && p[1] == '*') {
+            const char *close = find_comment_end(p + 2, end, line, simd);
+            if (!close)
+                return false;
+            p = close + 2;
+            continue;
+        }
+        return true;
+    }
+}
+
+Token
+Lexer::next ()
+{
+    Token tok;
+    bool ok = skip();
+
+    tok.start = p;
+    tok.line = line;
+
+    if (!ok) {
+        tok.type = TOKEN_ERROR;
+        tok.length = end - p;
+        p = end;
+        return tok;
+    }
+
+    if (p >= end) {
+        tok.type = TOKEN_EOF;
+        tok.length = 0;
+        return tok;
+    }
+
+    char c = *p;
+
+    if (is_digit(c)) {
+        tok.type = TOKEN_INTEGER;
+        p = skip_digits(p, end, simd);
+        if (p + 1 < end && *p == '.' && is_digit(p[1])) {
+            tok.type = TOKEN_REAL;
+            p = skip_digits(p + 1, end, simd);
+        }
+    } else if (is_ident(c)) {
+        tok.type = TOKEN_IDENT;
+        p = skip_ident(p, end, simd);
+    } else if (c == '"') {
+        const char *q = p + 1;
+        while (q < end && *q != '"') {
+            if (*q == '\\')
+                q++;
+            line += q < end && *q == '\n';
+            q++;
+        }
+        if (q >= end) {
+            tok.type = TOKEN_ERROR;
+            p = end;
+        } else {
+            tok.type = TOKEN_STRING;
+            p = q + 1;
+        }
+    } else if (c && strchr("=!<>", c) && p + 1 < end && p[1] == '=') {
+        tok.type = TOKEN_OP;
+        p += 2;
+    } else if (c && strchr("+-*/=<>(){};,", c)) {
+        tok.type = TOKEN_OP;
+        p++;
+    } else {
+        tok.type = TOKEN_ERROR;
+        p++;
+    }
+
+    tok.length = p - tok.start;
+    return tok;
+}
+
+Token
+Lexer::peek ()
+{
+    const char *save_p = p;
+    unsigned save_line = line;
+    Token tok = next();
+    p = save_p;
+    line = save_line;
+    return tok;
+}
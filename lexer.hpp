@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+
+typedef enum _TokenType {
+    TOKEN_EOF,
+    TOKEN_IDENT,    /* identifiers and keywords */
+    TOKEN_INTEGER,  /* 123 */
+    TOKEN_REAL,     /* 1.5 */
+    TOKEN_STRING,   /* "foo", including the quotes */
+    TOKEN_OP,       /* punctuation and operators, e.g. ; ( == */
+    TOKEN_ERROR     /* bad character, unterminated string or comment */
+} TokenType;
+
+/*
+ * Tokens never copy the input. They point directly into the text being
+ * lexed which must outlive them.
+ */
+struct Token {
+    TokenType type;
+    const char *start;
+    unsigned length;
+    unsigned line;
+
+    std::string text () const;
+    bool is (const char *str) const;
+};
+
+/*
+ * The Lexer splits text into tokens. Whitespace, comments, identifiers and
+ * runs of digits are scanned 16 bytes at a time with SSE2 where available,
+ * finishing the last few bytes of the input one at a time. The lexer never
+ * reads outside of [begin, end) so the text may be a memory mapping.
+ */
+class Lexer {
+public:
+    Lexer (const char *begin, const char *end, unsigned line = 1);
+
+    /* consume and return the next token */
+    Token next ();
+
+    /* return the next token without consuming it */
+    Token peek ();
+
+    /* where the next token will be lexed from */
+    const char* position () const;
+
+protected:
+    /* skip whitespace and comments, false on an unterminated comment */
+    bool skip ();
+
+    const char *p;
+    const char *end;
+    unsigned line;
+
+    /* scan with SSE2 where built in, only cleared to test the scalar loops */
+    bool simd;
+};
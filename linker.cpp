@@ -0,0 +1,82 @@
+#include <algorithm>
+#include "error.hpp"
+#include "machine.hpp"
+#include "linker.hpp"
+
+unsigned
+Linker::add (const Expression &expr)
+{
+    assert(expr.is_finished);
+    modules.push_back(&expr);
+    return modules.size() - 1;
+}
+
+Expression
+Linker::link ()
+{
+    Expression linked;
+
+    /*
+     * Every module's code is emitted into the linked expression through the
+     * same backpatching used while building any expression. Finishing it then
+     * lays out the shared constants and the merged locals.
+     */
+    for (auto expr : modules) {
+        const std::vector<Instruction> &code = expr->bytecode;
+
+        /* map this module's local indices onto the merged locals */
+        std::vector<std::pair<unsigned, std::string>> names;
+        for (auto &p : expr->locals)
+            names.push_back(std::make_pair(p.second, p.first));
+        std::sort(names.begin(), names.end());
+
+        std::vector<unsigned> remap(names.size());
+        for (auto &p : names)
+            remap[p.first] = linked.add_or_get_local(p.second);
+
+        /* the module's halt is always its last instruction, drop it */
+        for (unsigned pc = expr->body(); pc + 1 < code.size(); pc++) {
+            Instruction ins = code[pc];
+            Opcode op = get_opcode(ins);
+            int32_t imm = get_imm(ins);
+
+            switch (op) {
+                case OP_PUSHC:
+                    linked.create_constant_backpatch(code[pc + imm]);
+                    break;
+
+                case OP_PUSHW:
+                    linked.create_wide_backpatch(
+                        ((uint64_t) code[pc + imm + 1] << 32) | code[pc + imm]);
+                    break;
+
+                case OP_LOADL:
+                case OP_STOREL:
+                    assert(imm >= 0 && imm < (int32_t) remap.size());
+                    linked.bytecode.push_back(create_instruction(op, remap[imm]));
+                    break;
+
+                /* every name instruction keeps a cache of its own */
+                case OP_LOADN:
+                case OP_STOREN:
+                    assert(imm >= 0 && imm < (int32_t) expr->names.size());
+                    linked.bytecode.push_back(
+                        create_instruction(op, linked.add_name(expr->names[imm].name)));
+                    break;
+
+                default:
+                    linked.bytecode.push_back(ins);
+                    break;
+            }
+        }
+    }
+
+    linked.finish();
+
+    /* a module leaving nothing of its own leaves an earlier module's value */
+    for (auto expr : modules)
+        if (expr->result != VALUE_NONE)
+            linked.result = expr->result;
+
+    return linked;
+}
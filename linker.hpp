@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+#include "expression.hpp"
+
+/*
+ * The Linker chains finished Expressions together into a single Expression,
+ * relying on all references to bytecode being relative. The linked
+ * expression has the same format as any other:
+ *
+ * +-------------------+
+ * |  Shared Constants |
+ * +-------------------+ <---- Entry Point
+ * |  Merged Locals    |
+ * +-------------------+
+ * |  Module 0 Code    |
+ * +-------------------+
+ * |        ...        |
+ * +-------------------+
+ * |  Module N Code    |
+ * +-------------------+
+ * |        Halt       |
+ * +-------------------+
+ *
+ * Constants are deduplicated across every module. Locals are merged by name
+ * so a local assigned in one module can be loaded by a later one. Each
+ * module's halt is dropped so execution falls through into the next module.
+ */
+class Linker {
+public:
+    /* add a finished expression to be linked, returns its module index */
+    unsigned add (const Expression &expr);
+
+    /* link all added modules in the order they were added */
+    Expression link ();
+
+protected:
+    std::vector<const Expression*> modules;
+};
@@ -1,5 +1,9 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
 #include "error.hpp"
 #include "machine.hpp"
+#include "environment.hpp"
 
 /*
  * Right now instructions are:
@@ -54,7 +58,7 @@ struct Context {
     const int32_t reg_b;
 };
 
-#define DEBUG true
+#define DEBUG false
 #define STACK_MAX 250
 
 /* general purpose registers */
@@ -65,12 +69,32 @@ static uint32_t RA = 0;
 static uint32_t FP = 0;
 static uint8_t STACK_INDEX = 0;
 static int32_t STACK[STACK_MAX] = {0};
+/* Environment holding session globals */
+static Environment *ENV = nullptr;
+
+/* raised by a faulting instruction and caught where evaluation started */
+struct Trap {
+    std::string message;
+};
+
+static void trap (const char *fmt, ...) __attribute__((noreturn));
+
+static void
+trap (const char *fmt, ...)
+{
+    char buff[256];
+    va_list argp;
+    va_start(argp, fmt);
+    vsnprintf(buff, sizeof(buff), fmt, argp);
+    va_end(argp);
+    throw Trap{ buff };
+}
 
 void
 stack_push (int32_t val)
 {
     if (STACK_INDEX >= STACK_MAX)
-        panic("stack overflow\n");
+        trap("stack overflow");
     STACK[STACK_INDEX] = val;
     STACK_INDEX++;
     if (DEBUG)
@@ -85,7 +109,7 @@ stack_pop ()
      * codes, i.e. numbers that have bits set in the opcode areas.
      */
     if (STACK_INDEX == 0)
-        panic("stack underflow\n");
+        trap("stack underflow");
     int32_t val = STACK[STACK_INDEX - 1];
     STACK_INDEX--;
     if (DEBUG)
@@ -93,6 +117,193 @@ stack_pop ()
     return val;
 }
 
+void
+bind_environment (Environment *env)
+{
+    ENV = env;
+}
+
+/* the integer symbol backing a session global */
+static Symbol*
+global (int32_t index)
+{
+    if (!ENV || index < 0 || index >= (int32_t) ENV->local_count())
+        trap("segmentation fault");
+    Symbol *sym = ENV->local(index);
+    if (sym->type() != INTEGER)
+        trap("global %d is not an integer", index);
+    return sym;
+}
+
+/*
+ * The integer symbol bound to a name instruction's name. A hit costs one
+ * compare of the cached version, a miss walks the environment chain.
+ */
+static Symbol*
+resolve (NameCache *cache)
+{
+    if (!ENV)
+        return nullptr;
+    if (cache->version == ENV->version())
+        return cache->symbol;
+
+    Symbol *sym = ENV->lookup(cache->name);
+    if (sym && sym->type() == INTEGER) {
+        cache->symbol = sym;
+        cache->version = ENV->version();
+    }
+    return sym;
+}
+
+static Symbol*
+named (NameCache *cache)
+{
+    if (!cache)
+        trap("segmentation fault");
+    Symbol *sym = resolve(cache);
+    if (!sym)
+        trap("undefined name %s", cache->name.c_str());
+    if (sym->type() != INTEGER)
+        trap("%s is not an integer", cache->name.c_str());
+    return sym;
+}
+
+/*
+ * Read the values of a pure expression's inputs into key. False if any of
+ * them can't be read, the expression is then run as usual and traps.
+ */
+static bool
+read_inputs (Expression &expr, std::vector<int32_t> &key)
+{
+    for (auto ins : expr.inputs()) {
+        int32_t imm = get_imm(ins);
+        Symbol *sym = nullptr;
+        if (get_opcode(ins) == OP_LOADG) {
+            if (ENV && imm >= 0 && imm < (int32_t) ENV->local_count())
+                sym = ENV->local(imm);
+        } else if (NameCache *cache = expr.name_cache(imm)) {
+            sym = resolve(cache);
+        }
+        if (!sym || sym->type() != INTEGER)
+            return false;
+        key.push_back(sym->integer());
+    }
+    return true;
+}
+
+/* integer division which traps instead of raising SIGFPE */
+static inline int32_t
+divide (int32_t a, int32_t b)
+{
+    if (b == 0 || (a == INT32_MIN && b == -1))
+        trap("division by zero or overflow");
+    return a / b;
+}
+
+/*
+ * Wide values take two slots on the stack, the low word pushed first.
+ */
+
+static void
+stack_push_wide (uint64_t bits)
+{
+    stack_push((int32_t) bits);
+    stack_push((int32_t) (bits >> 32));
+}
+
+static uint64_t
+stack_pop_wide ()
+{
+    uint32_t hi = stack_pop();
+    uint32_t lo = stack_pop();
+    return ((uint64_t) hi << 32) | lo;
+}
+
+/* read a wide constant, always 8 byte aligned, from the bytecode */
+static uint64_t
+load_wide (const Instruction *at)
+{
+    uint64_t bits;
+    memcpy(&bits, at, sizeof(bits));
+    return bits;
+}
+
+static const char*
+wide_name (Opcode op)
+{
+    switch (op) {
+        case OP_ADDL: return "addl";
+        case OP_SUBL: return "subl";
+        case OP_DIVL: return "divl";
+        case OP_MULL: return "mull";
+        case OP_ADDD: return "addd";
+        case OP_SUBD: return "subd";
+        case OP_DIVD: return "divd";
+        case OP_MULD: return "muld";
+        default:      return "?";
+    }
+}
+
+/* pop two wide operands, apply the operation and push the wide result */
+static void
+wide_arith (Opcode op)
+{
+    uint64_t b = stack_pop_wide();
+    uint64_t a = stack_pop_wide();
+    int64_t la = a, lb = b;
+    double da, db, dr;
+
+    if (DEBUG) printf("%s\n", wide_name(op));
+
+    memcpy(&da, &a, sizeof(da));
+    memcpy(&db, &b, sizeof(db));
+
+    switch (op) {
+        case OP_ADDL: stack_push_wide(la + lb); return;
+        case OP_SUBL: stack_push_wide(la - lb); return;
+        case OP_DIVL:
+            if (lb == 0 || (la == INT64_MIN && lb == -1))
+                trap("division by zero or overflow");
+            stack_push_wide(la / lb);
+            return;
+        case OP_MULL: stack_push_wide(la * lb); return;
+        case OP_ADDD: dr = da + db; break;
+        case OP_SUBD: dr = da - db; break;
+        case OP_DIVD: dr = da / db; break;
+        case OP_MULD: dr = da * db; break;
+        default:
+            trap("illegal instruction %d", op);
+            return;
+    }
+
+    memcpy(&a, &dr, sizeof(a));
+    stack_push_wide(a);
+}
+
+/* print the value left on top of the stack, wide values as a whole */
+static void
+print_result (ValueKind kind, std::ostream &output)
+{
+    if (STACK_INDEX == 0) {
+        output << "OK\n";
+        return;
+    }
+
+    if ((kind == VALUE_LONG || kind == VALUE_DOUBLE) && STACK_INDEX >= 2) {
+        uint64_t bits = stack_pop_wide();
+        if (kind == VALUE_LONG) {
+            output << (int64_t) bits << std::endl;
+        } else {
+            double val;
+            memcpy(&val, &bits, sizeof(val));
+            output << val << std::endl;
+        }
+        return;
+    }
+
+    output << stack_pop() << std::endl;
+}
+
 MachineContext
 get_context ()
 {
@@ -111,20 +322,63 @@ resume (MachineContext ctx, Expression &expr, std::ostream &output)
 }
 
 /*
- * Evaluate the given expression in the environment and print to output stream.
+ * Run an evaluation, turning a trap into a failed Result. Either way the
+ * stack is unwound to where the evaluation started so that the next
+ * evaluation's locals are found where its code expects them.
  */
-void
-evaluate (Expression &expr, std::ostream &output)
+template <typename Code>
+static Result
+guard (void (*run) (Code&, std::ostream&), Code &code, std::ostream &output)
+{
+    uint8_t base = STACK_INDEX;
+    Result result = { true, "" };
+
+    try {
+        run(code, output);
+    } catch (const Trap &trap) {
+        result.ok = false;
+        result.trap = trap.message;
+    }
+
+    STACK_INDEX = base;
+    return result;
+}
+
+static void
+run_switch (Expression &expr, std::ostream &output)
 {
     std::vector<Instruction> prog = expr.code();
     Instruction instruction;
     Opcode op;
     int32_t imm;
 
+    std::vector<int32_t> key, result;
+    unsigned base = 0;
+    bool memoize = false;
+    unsigned long version = ENV ? ENV->version() : 0;
+
     PC = expr.entry();
     FP = STACK_INDEX;
     RA = STACK_INDEX;
 
+    /*
+     * The result of a pure expression depends only on its inputs. Setup the
+     * locals first so a remembered result lands where the code would have
+     * left it, then skip evaluation entirely if the inputs have been seen.
+     */
+    if (expr.is_pure()) {
+        for (; PC < expr.body(); PC++)
+            stack_push(0);
+        base = STACK_INDEX;
+        memoize = read_inputs(expr, key);
+        if (memoize && expr.recall(version, key, result)) {
+            if (DEBUG) printf("memo hit\n");
+            for (auto val : result)
+                stack_push(val);
+            goto exit;
+        }
+    }
+
     while (true) {
         instruction = prog[PC++];
         op = get_opcode(instruction);
@@ -132,6 +386,10 @@ evaluate (Expression &expr, std::ostream &output)
 
         switch (op) {
             case OP_HALT:
+                if (memoize && STACK_INDEX >= base) {
+                    result.assign(STACK + base, STACK + STACK_INDEX);
+                    expr.remember(version, key, result);
+                }
                 if (DEBUG) printf("halt\n");
                 goto exit;
 
@@ -191,7 +449,7 @@ evaluate (Expression &expr, std::ostream &output)
                 if (DEBUG) printf("div\n");
                 B = stack_pop();
                 A = stack_pop();
-                stack_push(A / B);
+                stack_push(divide(A, B));
                 break;
 
             case OP_MULI:
@@ -202,19 +460,14 @@ evaluate (Expression &expr, std::ostream &output)
                 break;
 
             /*
-             * TODO:
-             * When I make the Machine symbolic, use this instruction to setup
-             * the Environment (prematurely removed) to hold values between
-             * execution of expressions. Since the values in the Machine will
-             * all be Symbols then they will be easily updated or changed
-             * arbitrarily. Thie effectively allows:
+             * Locals only live on the stack for a single evaluation. Values
+             * which need to be held between execution of expressions live in
+             * the bound Environment as globals instead. This is what allows:
              *
              * > int a = 5;
              * OK
              * > a;
              * 5
-             *
-             * Whereas now, the Machine running on binary, this is impossible.
              */
             case OP_SETL:
                 if (DEBUG) printf("setup local\n");
@@ -224,17 +477,53 @@ evaluate (Expression &expr, std::ostream &output)
             case OP_LOADL:
                 if (DEBUG) printf("loadl %d\n", imm);
                 if (imm < 0 || imm >= STACK_MAX)
-                    panic("segmentation fault\n");
+                    trap("segmentation fault");
                 stack_push(STACK[imm]);
                 break;
 
             case OP_STOREL:
                 if (DEBUG) printf("storel %d\n", imm);
                 if (imm < 0 || imm >= STACK_MAX)
-                    panic("segmentation fault\n");
+                    trap("segmentation fault");
                 STACK[imm] = stack_pop();
                 break;
 
+            case OP_PUSHW:
+                if (DEBUG) printf("pushw %d\n", imm);
+                stack_push_wide(load_wide(&prog[PC - 1 + imm]));
+                break;
+
+            case OP_ADDL:
+            case OP_SUBL:
+            case OP_DIVL:
+            case OP_MULL:
+            case OP_ADDD:
+            case OP_SUBD:
+            case OP_DIVD:
+            case OP_MULD:
+                wide_arith(op);
+                break;
+
+            case OP_LOADG:
+                if (DEBUG) printf("loadg %d\n", imm);
+                stack_push(global(imm)->integer());
+                break;
+
+            case OP_STOREG:
+                if (DEBUG) printf("storeg %d\n", imm);
+                global(imm)->set(0, (int) stack_pop());
+                break;
+
+            case OP_LOADN:
+                if (DEBUG) printf("loadn %d\n", imm);
+                stack_push(named(expr.name_cache(imm))->integer());
+                break;
+
+            case OP_STOREN:
+                if (DEBUG) printf("storen %d\n", imm);
+                named(expr.name_cache(imm))->set(0, (int) stack_pop());
+                break;
+
             case OP_JMP:
                 if (DEBUG) printf("j %d\n", imm);
                 PC = PC - 1 + imm;
@@ -246,15 +535,641 @@ evaluate (Expression &expr, std::ostream &output)
             //    break;
 
             default:
-                panic("illegal instruction %d\n", op);
+                trap("illegal instruction %d", op);
                 break;
         }
     }
 
 exit:
-    if (STACK_INDEX > 0) {
-        output << stack_pop() << std::endl;
-    } else {
-        output << "OK\n";
+    print_result(expr.result_kind(), output);
+}
+
+Result
+evaluate (Expression &expr, std::ostream &output)
+{
+    return guard(run_switch, expr, output);
+}
+
+/*
+ * The stack caching interpreter keeps up to two of the topmost stack values
+ * in the locals R0 and R1 instead of in STACK. The logical stack is STACK
+ * followed by the cached values where R0 is below R1. Each opcode has one
+ * handler per cache depth, so an expression such as `3 * a / 2 - b` only
+ * touches STACK for its locals. The cache is spilled when a third value is
+ * pushed, when locals are set up, and when halting.
+ */
+
+/* pop both operands from memory, leave the result cached */
+#define BINOP_D0(OPC, NAME, EXPR) \
+    case OPC: \
+        if (DEBUG) printf(NAME "\n"); \
+        B = stack_pop(); \
+        A = stack_pop(); \
+        R0 = (EXPR); \
+        depth = 1; \
+        break;
+
+/* right operand is cached, left comes from memory */
+#define BINOP_D1(OPC, NAME, EXPR) \
+    case OPC: \
+        if (DEBUG) printf(NAME "\n"); \
+        B = R0; \
+        A = stack_pop(); \
+        R0 = (EXPR); \
+        break;
+
+/* both operands are cached */
+#define BINOP_D2(OPC, NAME, EXPR) \
+    case OPC: \
+        if (DEBUG) printf(NAME "\n"); \
+        A = R0; \
+        B = R1; \
+        R0 = (EXPR); \
+        depth = 1; \
+        break;
+
+#define BINOPS(BINOP) \
+    BINOP(OP_CMPEQ, "cmpeq", A == B) \
+    BINOP(OP_CMPNE, "cmpne", A != B) \
+    BINOP(OP_CMPGT, "cmpgt", A > B) \
+    BINOP(OP_CMPLT, "cmplt", A < B) \
+    BINOP(OP_ADDI, "add", A + B) \
+    BINOP(OP_SUBI, "sub", A - B) \
+    BINOP(OP_DIVI, "div", divide(A, B)) \
+    BINOP(OP_MULI, "mul", A * B)
+
+static void
+run_cached (Expression &expr, std::ostream &output)
+{
+    std::vector<Instruction> prog = expr.code();
+    Instruction instruction;
+    Opcode op;
+    int32_t imm;
+    int32_t R0 = 0, R1 = 0, val;
+    unsigned depth = 0;
+
+    PC = expr.entry();
+    FP = STACK_INDEX;
+    RA = STACK_INDEX;
+
+    while (true) {
+        instruction = prog[PC++];
+        op = get_opcode(instruction);
+        imm = get_imm(instruction);
+
+        /* wide values always go through memory so spill the cache */
+        if (op >= OP_PUSHW && op <= OP_MULD) {
+            if (depth > 0)
+                stack_push(R0);
+            if (depth > 1)
+                stack_push(R1);
+            depth = 0;
+        }
+
+        /* bounds check locals once rather than in every depth's handler */
+        if (op == OP_LOADL || op == OP_STOREL) {
+            if (imm < 0 || imm >= STACK_MAX)
+                trap("segmentation fault");
+        }
+
+        switch (depth) {
+        case 0:
+            switch (op) {
+                case OP_HALT:
+                    if (DEBUG) printf("halt\n");
+                    goto exit;
+
+                case OP_PUSHC:
+                    if (DEBUG) printf("pushc %d\n", imm);
+                    R0 = prog[PC - 1 + imm];
+                    depth = 1;
+                    break;
+
+                case OP_POP:
+                    if (DEBUG) printf("pop %d\n", imm);
+                    stack_pop();
+                    break;
+
+                BINOPS(BINOP_D0)
+
+                case OP_SETL:
+                    if (DEBUG) printf("setup local\n");
+                    stack_push(0);
+                    break;
+
+                case OP_LOADL:
+                    if (DEBUG) printf("loadl %d\n", imm);
+                    R0 = STACK[imm];
+                    depth = 1;
+                    break;
+
+                case OP_STOREL:
+                    if (DEBUG) printf("storel %d\n", imm);
+                    val = stack_pop();
+                    STACK[imm] = val;
+                    break;
+
+                case OP_LOADG:
+                    if (DEBUG) printf("loadg %d\n", imm);
+                    R0 = global(imm)->integer();
+                    depth = 1;
+                    break;
+
+                case OP_LOADN:
+                    if (DEBUG) printf("loadn %d\n", imm);
+                    R0 = named(expr.name_cache(imm))->integer();
+                    depth = 1;
+                    break;
+
+                case OP_PUSHW:
+                    if (DEBUG) printf("pushw %d\n", imm);
+                    stack_push_wide(load_wide(&prog[PC - 1 + imm]));
+                    break;
+
+                case OP_ADDL:
+                case OP_SUBL:
+                case OP_DIVL:
+                case OP_MULL:
+                case OP_ADDD:
+                case OP_SUBD:
+                case OP_DIVD:
+                case OP_MULD:
+                    wide_arith(op);
+                    break;
+
+                case OP_STOREG:
+                    if (DEBUG) printf("storeg %d\n", imm);
+                    global(imm)->set(0, (int) stack_pop());
+                    break;
+
+                case OP_STOREN:
+                    if (DEBUG) printf("storen %d\n", imm);
+                    named(expr.name_cache(imm))->set(0, (int) stack_pop());
+                    break;
+
+                case OP_JMP:
+                    if (DEBUG) printf("j %d\n", imm);
+                    PC = PC - 1 + imm;
+                    break;
+
+                default:
+                    trap("illegal instruction %d", op);
+                    break;
+            }
+            break;
+
+        case 1:
+            switch (op) {
+                case OP_HALT:
+                    if (DEBUG) printf("halt\n");
+                    stack_push(R0);
+                    goto exit;
+
+                case OP_PUSHC:
+                    if (DEBUG) printf("pushc %d\n", imm);
+                    R1 = prog[PC - 1 + imm];
+                    depth = 2;
+                    break;
+
+                case OP_POP:
+                    if (DEBUG) printf("pop %d\n", imm);
+                    depth = 0;
+                    break;
+
+                BINOPS(BINOP_D1)
+
+                case OP_SETL:
+                    if (DEBUG) printf("setup local\n");
+                    stack_push(R0);
+                    stack_push(0);
+                    depth = 0;
+                    break;
+
+                case OP_LOADL:
+                    if (DEBUG) printf("loadl %d\n", imm);
+                    R1 = (imm == STACK_INDEX) ? R0 : STACK[imm];
+                    depth = 2;
+                    break;
+
+                case OP_STOREL:
+                    if (DEBUG) printf("storel %d\n", imm);
+                    STACK[imm] = R0;
+                    depth = 0;
+                    break;
+
+                case OP_LOADG:
+                    if (DEBUG) printf("loadg %d\n", imm);
+                    R1 = global(imm)->integer();
+                    depth = 2;
+                    break;
+
+                case OP_STOREG:
+                    if (DEBUG) printf("storeg %d\n", imm);
+                    global(imm)->set(0, (int) R0);
+                    depth = 0;
+                    break;
+
+                case OP_LOADN:
+                    if (DEBUG) printf("loadn %d\n", imm);
+                    R1 = named(expr.name_cache(imm))->integer();
+                    depth = 2;
+                    break;
+
+                case OP_STOREN:
+                    if (DEBUG) printf("storen %d\n", imm);
+                    named(expr.name_cache(imm))->set(0, (int) R0);
+                    depth = 0;
+                    break;
+
+                case OP_JMP:
+                    if (DEBUG) printf("j %d\n", imm);
+                    PC = PC - 1 + imm;
+                    break;
+
+                default:
+                    trap("illegal instruction %d", op);
+                    break;
+            }
+            break;
+
+        case 2:
+            switch (op) {
+                case OP_HALT:
+                    if (DEBUG) printf("halt\n");
+                    stack_push(R0);
+                    stack_push(R1);
+                    goto exit;
+
+                case OP_PUSHC:
+                    if (DEBUG) printf("pushc %d\n", imm);
+                    stack_push(R0);
+                    R0 = R1;
+                    R1 = prog[PC - 1 + imm];
+                    break;
+
+                case OP_POP:
+                    if (DEBUG) printf("pop %d\n", imm);
+                    depth = 1;
+                    break;
+
+                BINOPS(BINOP_D2)
+
+                case OP_SETL:
+                    if (DEBUG) printf("setup local\n");
+                    stack_push(R0);
+                    stack_push(R1);
+                    stack_push(0);
+                    depth = 0;
+                    break;
+
+                case OP_LOADL:
+                    if (DEBUG) printf("loadl %d\n", imm);
+                    if (imm == STACK_INDEX)
+                        val = R0;
+                    else if (imm == STACK_INDEX + 1)
+                        val = R1;
+                    else
+                        val = STACK[imm];
+                    stack_push(R0);
+                    R0 = R1;
+                    R1 = val;
+                    break;
+
+                case OP_STOREL:
+                    if (DEBUG) printf("storel %d\n", imm);
+                    if (imm == STACK_INDEX)
+                        R0 = R1;
+                    else
+                        STACK[imm] = R1;
+                    depth = 1;
+                    break;
+
+                case OP_LOADG:
+                    if (DEBUG) printf("loadg %d\n", imm);
+                    val = global(imm)->integer();
+                    stack_push(R0);
+                    R0 = R1;
+                    R1 = val;
+                    break;
+
+                case OP_STOREG:
+                    if (DEBUG) printf("storeg %d\n", imm);
+                    global(imm)->set(0, (int) R1);
+                    depth = 1;
+                    break;
+
+                case OP_LOADN:
+                    if (DEBUG) printf("loadn %d\n", imm);
+                    val = named(expr.name_cache(imm))->integer();
+                    stack_push(R0);
+                    R0 = R1;
+                    R1 = val;
+                    break;
+
+                case OP_STOREN:
+                    if (DEBUG) printf("storen %d\n", imm);
+                    named(expr.name_cache(imm))->set(0, (int) R1);
+                    depth = 1;
+                    break;
+
+                case OP_JMP:
+                    if (DEBUG) printf("j %d\n", imm);
+                    PC = PC - 1 + imm;
+                    break;
+
+                default:
+                    trap("illegal instruction %d", op);
+                    break;
+            }
+            break;
+        }
+    }
+
+exit:
+    print_result(expr.result_kind(), output);
+}
+
+Result
+evaluate_cached (Expression &expr, std::ostream &output)
+{
+    return guard(run_cached, expr, output);
+}
+
+/*
+ * Handlers for compiled thunks. Each is one instruction of `evaluate` with
+ * its operand already decoded.
+ */
+
+static const Thunk*
+thunk_halt (const Thunk *self)
+{
+    if (DEBUG) printf("halt\n");
+    return nullptr;
+}
+
+static const Thunk*
+thunk_pushc (const Thunk *self)
+{
+    if (DEBUG) printf("pushc %d\n", self->operand);
+    stack_push(self->operand);
+    return self + 1;
+}
+
+static const Thunk*
+thunk_pop (const Thunk *self)
+{
+    if (DEBUG) printf("pop %d\n", self->operand);
+    stack_pop();
+    return self + 1;
+}
+
+#define THUNK_BINOP(NAME, EXPR) \
+    static const Thunk* \
+    thunk_##NAME (const Thunk *self) \
+    { \
+        if (DEBUG) printf(#NAME "\n"); \
+        B = stack_pop(); \
+        A = stack_pop(); \
+        stack_push(EXPR); \
+        return self + 1; \
+    }
+
+THUNK_BINOP(cmpeq, A == B)
+THUNK_BINOP(cmpne, A != B)
+THUNK_BINOP(cmpgt, A > B)
+THUNK_BINOP(cmplt, A < B)
+THUNK_BINOP(add, A + B)
+THUNK_BINOP(sub, A - B)
+THUNK_BINOP(div, divide(A, B))
+THUNK_BINOP(mul, A * B)
+
+static const Thunk*
+thunk_setl (const Thunk *self)
+{
+    if (DEBUG) printf("setup local\n");
+    stack_push(0);
+    return self + 1;
+}
+
+static const Thunk*
+thunk_loadl (const Thunk *self)
+{
+    if (DEBUG) printf("loadl %d\n", self->operand);
+    stack_push(STACK[self->operand]);
+    return self + 1;
+}
+
+static const Thunk*
+thunk_storel (const Thunk *self)
+{
+    if (DEBUG) printf("storel %d\n", self->operand);
+    STACK[self->operand] = stack_pop();
+    return self + 1;
+}
+
+static const Thunk*
+thunk_loadg (const Thunk *self)
+{
+    if (DEBUG) printf("loadg %d\n", self->operand);
+    stack_push(global(self->operand)->integer());
+    return self + 1;
+}
+
+static const Thunk*
+thunk_storeg (const Thunk *self)
+{
+    if (DEBUG) printf("storeg %d\n", self->operand);
+    global(self->operand)->set(0, (int) stack_pop());
+    return self + 1;
+}
+
+static const Thunk*
+thunk_loadn (const Thunk *self)
+{
+    if (DEBUG) printf("loadn %d\n", self->operand);
+    stack_push(named(self->cache)->integer());
+    return self + 1;
+}
+
+static const Thunk*
+thunk_storen (const Thunk *self)
+{
+    if (DEBUG) printf("storen %d\n", self->operand);
+    named(self->cache)->set(0, (int) stack_pop());
+    return self + 1;
+}
+
+static const Thunk*
+thunk_pushw (const Thunk *self)
+{
+    if (DEBUG) printf("pushw\n");
+    stack_push_wide(self->wide);
+    return self + 1;
+}
+
+static const Thunk*
+thunk_wide (const Thunk *self)
+{
+    wide_arith(self->operand);
+    return self + 1;
+}
+
+static const Thunk*
+thunk_jmp (const Thunk *self)
+{
+    if (DEBUG) printf("j\n");
+    return self->target;
+}
+
+/* faults are found while compiling but only raised if they're executed */
+
+static const Thunk*
+thunk_segfault (const Thunk *self)
+{
+    trap("segmentation fault");
+    return nullptr;
+}
+
+static const Thunk*
+thunk_illegal (const Thunk *self)
+{
+    trap("illegal instruction %d", self->operand);
+    return nullptr;
+}
+
+Compiled::Compiled (Expression &expr)
+{
+    std::vector<Instruction> prog = expr.code();
+    unsigned entry = expr.entry();
+    Thunk fault = { thunk_segfault, 0, 0, nullptr, nullptr };
+
+    result = expr.result_kind();
+
+    /* the compiled code has caches of its own, they never move once copied */
+    names.clear();
+    for (unsigned i = 0; i < expr.name_count(); i++)
+        names.push_back(*expr.name_cache(i));
+
+    /* one thunk per instruction from the entry point plus a trailing fault */
+    thunks.resize(prog.size() - entry + 1, fault);
+
+    for (unsigned pc = entry; pc < prog.size(); pc++) {
+        Thunk &t = thunks[pc - entry];
+        Opcode op = get_opcode(prog[pc]);
+        int32_t imm = get_imm(prog[pc]);
+        int32_t dest;
+
+        t.operand = imm;
+        t.wide = 0;
+        t.target = nullptr;
+        t.cache = nullptr;
+
+        switch (op) {
+            case OP_HALT:   t.handler = thunk_halt;  break;
+            case OP_POP:    t.handler = thunk_pop;   break;
+            case OP_CMPEQ:  t.handler = thunk_cmpeq; break;
+            case OP_CMPNE:  t.handler = thunk_cmpne; break;
+            case OP_CMPGT:  t.handler = thunk_cmpgt; break;
+            case OP_CMPLT:  t.handler = thunk_cmplt; break;
+            case OP_ADDI:   t.handler = thunk_add;   break;
+            case OP_SUBI:   t.handler = thunk_sub;   break;
+            case OP_DIVI:   t.handler = thunk_div;   break;
+            case OP_MULI:   t.handler = thunk_mul;   break;
+            case OP_SETL:   t.handler = thunk_setl;  break;
+            case OP_LOADG:  t.handler = thunk_loadg; break;
+            case OP_STOREG: t.handler = thunk_storeg; break;
+
+            case OP_LOADN:
+            case OP_STOREN:
+                t.handler = op == OP_LOADN ? thunk_loadn : thunk_storen;
+                if (imm >= 0 && imm < (int32_t) names.size())
+                    t.cache = &names[imm];
+                break;
+
+            case OP_PUSHC:
+                /* embed the constant itself rather than where it lives */
+                dest = pc + imm;
+                if (dest < 0 || dest >= (int32_t) prog.size()) {
+                    t.handler = thunk_segfault;
+                } else {
+                    t.handler = thunk_pushc;
+                    t.operand = prog[dest];
+                }
+                break;
+
+            case OP_PUSHW:
+                dest = pc + imm;
+                if (dest < 0 || dest + 1 >= (int32_t) prog.size()) {
+                    t.handler = thunk_segfault;
+                } else {
+                    t.handler = thunk_pushw;
+                    t.wide = load_wide(&prog[dest]);
+                }
+                break;
+
+            case OP_ADDL:
+            case OP_SUBL:
+            case OP_DIVL:
+            case OP_MULL:
+            case OP_ADDD:
+            case OP_SUBD:
+            case OP_DIVD:
+            case OP_MULD:
+                t.handler = thunk_wide;
+                t.operand = op;
+                break;
+
+            case OP_LOADL:
+            case OP_STOREL:
+                if (imm < 0 || imm >= STACK_MAX)
+                    t.handler = thunk_segfault;
+                else
+                    t.handler = op == OP_LOADL ? thunk_loadl : thunk_storel;
+                break;
+
+            case OP_JMP:
+                dest = pc + imm;
+                t.handler = thunk_jmp;
+                if (dest < (int32_t) entry || dest >= (int32_t) prog.size())
+                    t.target = &thunks.back();
+                else
+                    t.target = &thunks[dest - entry];
+                break;
+
+            default:
+                t.handler = thunk_illegal;
+                t.operand = op;
+                break;
+        }
     }
 }
+
+const Thunk*
+Compiled::entry () const
+{
+    return &thunks[0];
+}
+
+ValueKind
+Compiled::result_kind () const
+{
+    return result;
+}
+
+static void
+run_compiled (const Compiled &code, std::ostream &output)
+{
+    FP = STACK_INDEX;
+    RA = STACK_INDEX;
+
+    for (const Thunk *t = code.entry(); t; t = t->handler(t))
+        ;
+
+    print_result(code.result_kind(), output);
+}
+
+Result
+evaluate (const Compiled &code, std::ostream &output)
+{
+    return guard(run_compiled, code, output);
+}
@@ -1,9 +1,12 @@
 #pragma once
 
 #include <iostream>
+#include <string>
 #include "instructions.hpp"
 #include "expression.hpp"
 
+class Environment;
+
 struct MachineContext {
     MachineContext (uint32_t m, int8_t i, int32_t *s, int32_t f,
                     int32_t r, int32_t p, int32_t a, int32_t b)
@@ -27,10 +30,82 @@ Instruction create_instruction (Opcode op);
 Opcode get_opcode (Instruction ins);
 int32_t get_imm (Instruction ins);
 
+/*
+ * The outcome of an evaluation. A trap, such as a stack overflow, an illegal
+ * instruction or an access outside of the stack, stops the expression but
+ * never the process. The machine is left ready for the next evaluation.
+ */
+struct Result {
+    bool ok;
+    std::string trap;  /* what went wrong when not ok */
+};
+
 /*
  * Evaluate the given expression in the environment and print to output stream.
  */
-void evaluate (Expression &expr, std::ostream &output);
+Result evaluate (Expression &expr, std::ostream &output);
+
+/*
+ * Bind the Environment whose locals back the session globals accessed by
+ * OP_LOADG and OP_STOREG. Globals outlive any single evaluation so values can
+ * be carried from one expression to the next.
+ */
+void bind_environment (Environment *env);
+
+/*
+ * Evaluate the given expression keeping the top two values of the stack
+ * cached in registers. Produces exactly the same results as `evaluate`.
+ */
+Result evaluate_cached (Expression &expr, std::ostream &output);
+
+/*
+ * A Thunk is a single pre-decoded instruction: the handler which executes it
+ * along with its already resolved operand (a constant's value or a local's
+ * index), the value of a wide constant, for jumps the Thunk it jumps to, and
+ * for names their inline cache. Each handler returns the next Thunk to
+ * execute or NULL to halt.
+ */
+struct Thunk;
+typedef const Thunk* (*Handler) (const Thunk *self);
+
+struct Thunk {
+    Handler handler;
+    int32_t operand;
+    uint64_t wide;
+    const Thunk *target;
+    NameCache *cache;
+};
+
+/*
+ * An Expression compiled into a flat array of Thunks. Executing it requires
+ * no decoding of opcodes or immediates and no constant lookups, it is just a
+ * tight loop of calls. This is a portable alternative to generating machine
+ * code as it never needs executable memory.
+ */
+class Compiled {
+public:
+    Compiled (Expression &expr);
+
+    /* thunks point into each other so the array can't be copied */
+    Compiled (const Compiled &other) = delete;
+    Compiled& operator= (const Compiled &other) = delete;
+
+    /* the first thunk to execute */
+    const Thunk* entry () const;
+
+    /* what the expression leaves on top of the stack */
+    ValueKind result_kind () const;
+
+protected:
+    std::vector<Thunk> thunks;
+    std::vector<NameCache> names;
+    ValueKind result;
+};
+
+/*
+ * Evaluate the compiled expression and print to output stream.
+ */
+Result evaluate (const Compiled &code, std::ostream &output);
 
 /*
  * Get the Machine's context for debugging purposes.
@@ -5,23 +5,110 @@
 #include "symbol.hpp"
 #include "error.hpp"
 #include "machine.hpp"
+#include "cache.hpp"
+#include "disassembler.hpp"
+#include "parser.hpp"
+#include "source.hpp"
 
-void
+#define EVAL_CACHE_SIZE 256
+/* only input up to this size is cached, large scripts are run once */
+#define EVAL_CACHE_SOURCE_MAX 4096
+
+/* expressions already compiled from previous input */
+static ExpressionCache cache(EVAL_CACHE_SIZE);
+
+/* globals declared by each script are visible to the scripts after it */
+static Environment session;
+
+/* print the listing of each script instead of evaluating it */
+static bool listing = false;
+
+/* which of the machine's interpreters evaluates scripts */
+typedef enum { TIER_SWITCH, TIER_CACHED, TIER_THUNKS } Tier;
+static Tier tier = TIER_SWITCH;
+
+static Result
+run (Expression &expr, std::ostream &output)
+{
+    switch (tier) {
+        case TIER_CACHED:
+            return evaluate_cached(expr, output);
+
+        case TIER_THUNKS: {
+            Compiled code(expr);
+            return evaluate(code, output);
+        }
+
+        default:
+            return evaluate(expr, output);
+    }
+}
+
+/*
+ * Compile and evaluate (or list) a script. Compile errors and traps are
+ * reported on std::cerr and the session carries on, returns false if there
+ * were any.
+ */
+bool
+eval (const char *begin, const char *end, std::ostream &output)
+{
+    bool cacheable = (size_t) (end - begin) <= EVAL_CACHE_SOURCE_MAX;
+    Expression *expr = nullptr;
+    Result result = { true, "" };
+    ExpressionCache::Key key;
+
+    /* input which has been seen before skips straight to evaluation */
+    if (cacheable) {
+        key = ExpressionCache::key(std::string(begin, end));
+        expr = cache.find(key);
+    }
+
+    if (!expr) {
+        Compiler compiler(&session);
+        expr = compiler.compile(begin, end);
+        compiler.diagnostics().print(std::cerr);
+        if (!expr)
+            return false;
+        if (cacheable) {
+            cache.insert(key, expr);
+        } else {
+            if (listing)
+                Disassembler::print(*expr, output);
+            else
+                result = run(*expr, output);
+            delete expr;
+            expr = nullptr;
+        }
+    }
+
+    if (expr && listing)
+        Disassembler::print(*expr, output);
+    else if (expr)
+        result = run(*expr, output);
+    if (!result.ok)
+        std::cerr << "trap: " << result.trap << "\n";
+    return result.ok;
+}
+
+bool
 eval (std::istream &input, std::ostream &output)
 {
-    /*
-     * + Tokenize input stream
-     *   - bad characters
-     * + Parse tokens into AST
-     *   - malformed input, invalid sequences
-     * + Produce expression (bytecode) from AST
-     *   - undefined symbols, invalid types
-     * + Evaluate the expression
-     */
+    Source source(input);
+    return eval(source.begin(), source.end(), output);
 }
 
-int
-main (void)
+/* map the script at path and evaluate it in place */
+bool
+eval (const std::string &path, std::ostream &output)
+{
+    Diagnostics diag;
+    Source source(path, diag);
+    diag.print(std::cerr);
+    return source.ok() && eval(source.begin(), source.end(), output);
+}
+
+static void
+demo ()
 {
     Expression expr;
 
@@ -63,18 +150,73 @@ main (void)
     printf("b: %lf\n", b.floating());
     printf("c: %lf\n", c.ref()->floating());
 
-    Symbol s(24, 0);
     /* { int, double, int, double } */
+    Layout rec;
+    unsigned i1 = rec.add(FIELD_INT);
+    unsigned d1 = rec.add(FIELD_DOUBLE);
+    unsigned i2 = rec.add(FIELD_INT);
+    unsigned d2 = rec.add(FIELD_DOUBLE);
+    Symbol s(rec, 1, LAYOUT_AOS);
+
+    s.set(rec.offset(i1), 2);
+    s.set(rec.offset(d1), 2.5);
+    s.set(rec.offset(i2), 3);
+    s.set(rec.offset(d2), 3.5);
+
+    printf("s.i1: %d\n", s.integer_at(rec.offset(i1)));
+    printf("s.d1: %lf\n", s.floating_at(rec.offset(d1)));
+    printf("s.i2: %d\n", s.integer_at(rec.offset(i2)));
+    printf("s.d2: %lf\n", s.floating_at(rec.offset(d2)));
+
+    /* the same records as columns so a field can be scanned contiguously */
+    Symbol t(rec, 4, LAYOUT_SOA);
+    for (unsigned r = 0; r < 4; r++)
+        t.set(rec.offset(r, d1, 0, 4, LAYOUT_SOA), r * 1.5);
+    printf("t.d1[3]: %lf\n", t.floating_at(rec.offset(3, d1, 0, 4, LAYOUT_SOA)));
+}
+
+/*
+ * Usage: lang [-d] [-t switch|cached|thunks] [- | script]...
+ * Each argument is evaluated in order, '-' reads from stdin and anything
+ * else is the path of a script which is mapped into memory. With -d the
+ * scripts are compiled and their bytecode listed instead. -t picks the
+ * interpreter for the scripts after it: the plain switch (the default), the
+ * one caching the top of the stack in registers, or pre-decoded thunks.
+ */
+int
+main (int argc, char **argv)
+{
+    if (argc < 2) {
+        demo();
+        return 0;
+    }
+
+    bool ok = true;
 
-    s.set(0, 2);
-    s.set(4, 2.5);
-    s.set(12, 3);
-    s.set(16, 3.5);
+    bind_environment(&session);
 
-    printf("s.i1: %d\n", s.integer_at(0));
-    printf("s.d1: %lf\n", s.floating_at(4));
-    printf("s.i2: %d\n", s.integer_at(12));
-    printf("s.d2: %lf\n", s.floating_at(16));
+    /* a bad script doesn't stop the ones after it */
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "-d") {
+            listing = true;
+        } else if (std::string(argv[i]) == "-t" && i + 1 < argc) {
+            std::string name(argv[++i]);
+            if (name == "switch") {
+                tier = TIER_SWITCH;
+            } else if (name == "cached") {
+                tier = TIER_CACHED;
+            } else if (name == "thunks") {
+                tier = TIER_THUNKS;
+            } else {
+                std::cerr << "unknown interpreter '" << name << "'\n";
+                return 1;
+            }
+        } else if (std::string(argv[i]) == "-") {
+            ok = eval(std::cin, std::cout) && ok;
+        } else {
+            ok = eval(std::string(argv[i]), std::cout) && ok;
+        }
+    }
 
-    return 0;
+    return ok ? 0 : 1;
 }
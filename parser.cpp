@@ -0,0 +1,628 @@
+#include <algorithm>
+#include <atomic>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include "error.hpp"
+#include "lexer.hpp"
+#include "linker.hpp"
+#include "parser.hpp"
+
+/* statements compiled together by one thread, fewer than this runs inline */
+#define COMPILE_CHUNK 256
+
+static const char*
+type_name (ValueType type)
+{
+    switch (type) {
+        case TYPE_INT:    return "int";
+        case TYPE_STRING: return "string";
+        default:          return "error";
+    }
+}
+
+/*
+ * The type a bound symbol has in a script. Only ints and strings can be used
+ * so far, false for anything else.
+ */
+static bool
+symbol_value_type (const Symbol *sym, ValueType &type)
+{
+    switch (sym->type()) {
+        case INTEGER: type = TYPE_INT;    return true;
+        case STRING:  type = TYPE_STRING; return true;
+        default:      return false;
+    }
+}
+
+static const char*
+symbol_type_name (const Symbol *sym)
+{
+    switch (sym->type()) {
+        case INTEGER:   return "int";
+        case DOUBLE:    return "double";
+        case REFERENCE: return "reference";
+        case FUNCTION:  return "function";
+        case CHUNK:     return "chunk";
+        case STRING:    return "string";
+        default:        return "symbol";
+    }
+}
+
+static bool
+is_type_keyword (const Token &tok)
+{
+    return tok.type == TOKEN_IDENT &&
+        (tok.is("int") || tok.is("string") || tok.is("double"));
+}
+
+/*
+ * The Parser is a recursive descent parser which generates code directly
+ * into an Expression as it goes, there is no tree in between:
+ *
+ *   statement  := type IDENT '=' equality ';'
+ *               | IDENT '=' equality ';'
+ *               | equality ';'
+ *   equality   := comparison (('==' | '!=') comparison)*
+ *   comparison := additive (('<' | '>') additive)*
+ *   additive   := term (('+' | '-') term)*
+ *   term       := unary (('*' | '/') unary)*
+ *   unary      := '-' unary | primary
+ *   primary    := INTEGER | STRING | IDENT | '(' equality ')'
+ *
+ * Strings are type checked but the machine can't hold them yet so they never
+ * generate code. Parsing a statement stops at its first error.
+ */
+class Parser {
+public:
+    Parser (const Compiler &compiler, Expression &expr, Diagnostics &diag);
+
+    /* parse and generate code for the statement at index */
+    void statement (unsigned index);
+
+protected:
+    ValueType equality ();
+    ValueType comparison ();
+    ValueType additive ();
+    ValueType term ();
+    ValueType unary ();
+    ValueType primary ();
+
+    /* check both operands of op are integers */
+    ValueType binary (const Token &op, ValueType left, ValueType right);
+
+    /* find the declaration of name visible from the current statement */
+    bool resolve (const Token &name, Declaration &decl);
+    void load (const Token &name, const Declaration &decl);
+    void store (const Token &name, const Declaration &decl);
+
+    /* consume the operator str or report an error */
+    bool expect (const char *str);
+    void fail (const Token &at, const char *fmt, ...);
+
+    const Compiler &compiler;
+    Expression &expr;
+    Diagnostics &diag;
+    Lexer lexer;
+    unsigned current;
+    bool failed;
+};
+
+Parser::Parser (const Compiler &compiler, Expression &expr, Diagnostics &diag)
+    : compiler(compiler)
+    , expr(expr)
+    , diag(diag)
+    , lexer(nullptr, nullptr)
+    , current(0)
+    , failed(false)
+{ }
+
+void
+Parser::fail (const Token &at, const char *fmt, ...)
+{
+    char buff[256];
+    va_list argp;
+
+    if (failed)
+        return;
+    failed = true;
+
+    va_start(argp, fmt);
+    vsnprintf(buff, sizeof(buff), fmt, argp);
+    va_end(argp);
+
+    diag.error("line %u: %s\n", at.line, buff);
+}
+
+bool
+Parser::expect (const char *str)
+{
+    if (failed)
+        return false;
+    Token tok = lexer.next();
+    if (tok.type == TOKEN_ERROR) {
+        fail(tok, "bad input '%s'", tok.text().c_str());
+        return false;
+    }
+    if (tok.type != TOKEN_OP || !tok.is(str)) {
+        if (tok.type == TOKEN_EOF)
+            fail(tok, "expected '%s' at end of input", str);
+        else
+            fail(tok, "expected '%s' before '%s'", str, tok.text().c_str());
+        return false;
+    }
+    return true;
+}
+
+void
+Parser::statement (unsigned index)
+{
+    const Statement &stmt = compiler.statements[index];
+    lexer = Lexer(stmt.begin, stmt.end, stmt.line);
+    current = index;
+    failed = false;
+
+    Token first = lexer.peek();
+    Declaration decl;
+
+    if (is_type_keyword(first)) {
+        lexer.next();
+        Token name = lexer.next();
+        if (first.is("double")) {
+            fail(first, "type double is not supported yet");
+            return;
+        }
+        if (name.type != TOKEN_IDENT) {
+            fail(name, "expected a name after '%s'", first.text().c_str());
+            return;
+        }
+        if (!expect("="))
+            return;
+        ValueType type = equality();
+        if (!expect(";"))
+            return;
+        decl = compiler.declarations.at(name.text());
+        if (type != decl.type) {
+            fail(name, "cannot assign %s to %s '%s'", type_name(type),
+                 type_name(decl.type), name.text().c_str());
+            return;
+        }
+        store(name, decl);
+        return;
+    }
+
+    if (first.type == TOKEN_IDENT) {
+        Lexer save = lexer;
+        Token name = lexer.next();
+        Token op = lexer.next();
+        if (op.type == TOKEN_OP && op.is("=")) {
+            if (!resolve(name, decl))
+                return;
+            ValueType type = equality();
+            if (!expect(";"))
+                return;
+            if (type != decl.type) {
+                fail(name, "cannot assign %s to %s '%s'", type_name(type),
+                     type_name(decl.type), name.text().c_str());
+                return;
+            }
+            store(name, decl);
+            return;
+        }
+        lexer = save;
+    }
+
+    ValueType type = equality();
+    if (!expect(";"))
+        return;
+    if (type == TYPE_STRING) {
+        fail(first, "strings cannot be evaluated yet");
+        return;
+    }
+
+    /* only the value of the script's last statement is its result */
+    if (index + 1 < compiler.statements.size())
+        expr.pop();
+}
+
+ValueType
+Parser::binary (const Token &op, ValueType left, ValueType right)
+{
+    if (left == TYPE_ERROR || right == TYPE_ERROR)
+        return TYPE_ERROR;
+    if (left != TYPE_INT || right != TYPE_INT) {
+        if (left == TYPE_STRING)
+            fail(op, "strings cannot use the %s operator on numbers",
+                 op.text().c_str());
+        else
+            fail(op, "cannot use the %s operator on %s and %s",
+                 op.text().c_str(), type_name(left), type_name(right));
+        return TYPE_ERROR;
+    }
+    return TYPE_INT;
+}
+
+ValueType
+Parser::equality ()
+{
+    ValueType left = comparison();
+    for (;;) {
+        Token op = lexer.peek();
+        if (failed || op.type != TOKEN_OP || !(op.is("==") || op.is("!=")))
+            return left;
+        lexer.next();
+        left = binary(op, left, comparison());
+        op.is("==") ? expr.cmpeq() : expr.cmpne();
+    }
+}
+
+ValueType
+Parser::comparison ()
+{
+    ValueType left = additive();
+    for (;;) {
+        Token op = lexer.peek();
+        if (failed || op.type != TOKEN_OP || !(op.is("<") || op.is(">")))
+            return left;
+        lexer.next();
+        left = binary(op, left, additive());
+        op.is("<") ? expr.cmplt() : expr.cmpgt();
+    }
+}
+
+ValueType
+Parser::additive ()
+{
+    ValueType left = term();
+    for (;;) {
+        Token op = lexer.peek();
+        if (failed || op.type != TOKEN_OP || !(op.is("+") || op.is("-")))
+            return left;
+        lexer.next();
+        left = binary(op, left, term());
+        op.is("+") ? expr.addi() : expr.subi();
+    }
+}
+
+ValueType
+Parser::term ()
+{
+    ValueType left = unary();
+    for (;;) {
+        Token op = lexer.peek();
+        if (failed || op.type != TOKEN_OP || !(op.is("*") || op.is("/")))
+            return left;
+        lexer.next();
+        left = binary(op, left, unary());
+        op.is("*") ? expr.muli() : expr.divi();
+    }
+}
+
+ValueType
+Parser::unary ()
+{
+    Token op = lexer.peek();
+    if (op.type == TOKEN_OP && op.is("-")) {
+        lexer.next();
+        /* -x is 0 - x */
+        expr.push_constant(0);
+        ValueType type = binary(op, TYPE_INT, unary());
+        expr.subi();
+        return type;
+    }
+    return primary();
+}
+
+ValueType
+Parser::primary ()
+{
+    if (failed)
+        return TYPE_ERROR;
+
+    Token tok = lexer.next();
+    Declaration decl;
+
+    switch (tok.type) {
+        case TOKEN_INTEGER: {
+            errno = 0;
+            long val = strtol(tok.text().c_str(), nullptr, 10);
+            if (errno || val > INT32_MAX) {
+                fail(tok, "integer %s is too large", tok.text().c_str());
+                return TYPE_ERROR;
+            }
+            expr.push_constant((int) val);
+            return TYPE_INT;
+        }
+
+        case TOKEN_STRING:
+            return TYPE_STRING;
+
+        case TOKEN_IDENT:
+            if (is_type_keyword(tok)) {
+                fail(tok, "unexpected '%s'", tok.text().c_str());
+                return TYPE_ERROR;
+            }
+            if (!resolve(tok, decl))
+                return TYPE_ERROR;
+            load(tok, decl);
+            return decl.type;
+
+        case TOKEN_OP:
+            if (tok.is("(")) {
+                ValueType type = equality();
+                return expect(")") ? type : TYPE_ERROR;
+            }
+            fail(tok, "unexpected '%s'", tok.text().c_str());
+            return TYPE_ERROR;
+
+        case TOKEN_REAL:
+            fail(tok, "doubles are not supported yet");
+            return TYPE_ERROR;
+
+        case TOKEN_EOF:
+            fail(tok, "unexpected end of input");
+            return TYPE_ERROR;
+
+        default:
+            fail(tok, "bad input '%s'", tok.text().c_str());
+            return TYPE_ERROR;
+    }
+}
+
+bool
+Parser::resolve (const Token &name, Declaration &decl)
+{
+    auto it = compiler.declarations.find(name.text());
+    if (it != compiler.declarations.end() &&
+        (it->second.preexisting || it->second.statement < current)) {
+        decl = it->second;
+        return true;
+    }
+    /* the environment isn't modified while statements are being compiled */
+    if (it == compiler.declarations.end() && compiler.env) {
+        int index = compiler.env->local_index(name.text());
+        Symbol *sym = index >= 0 ? compiler.env->local(index)
+                                 : compiler.env->lookup(name.text());
+        if (sym && !symbol_value_type(sym, decl.type)) {
+            fail(name, "'%s' is a %s which cannot be used yet",
+                 name.text().c_str(), symbol_type_name(sym));
+            return false;
+        }
+        if (index >= 0) {
+            decl.statement = 0;
+            decl.preexisting = true;
+            decl.inherited = false;
+            decl.global = index;
+            return true;
+        }
+        /* found further up the chain, the name is resolved at run time */
+        if (sym) {
+            decl.statement = 0;
+            decl.preexisting = true;
+            decl.inherited = true;
+            decl.global = -1;
+            return true;
+        }
+    }
+    fail(name, "undefined variable '%s'", name.text().c_str());
+    return false;
+}
+
+void
+Parser::load (const Token &name, const Declaration &decl)
+{
+    if (decl.type != TYPE_INT)
+        return;
+    if (decl.inherited)
+        expr.load_name(name.text());
+    else if (decl.global >= 0)
+        expr.load_global(decl.global);
+    else
+        expr.load_local(name.text());
+}
+
+void
+Parser::store (const Token &name, const Declaration &decl)
+{
+    if (decl.type != TYPE_INT) {
+        fail(name, "strings cannot be assigned yet");
+        return;
+    }
+    if (decl.inherited)
+        expr.store_name(name.text());
+    else if (decl.global >= 0)
+        expr.store_global(decl.global);
+    else
+        expr.store_local(name.text());
+}
+
+Compiler::Compiler (Environment *env)
+    : env(env)
+{ }
+
+const Diagnostics&
+Compiler::diagnostics () const
+{
+    return diag;
+}
+
+bool
+Compiler::split (const char *begin, const char *end)
+{
+    Lexer lexer(begin, end);
+    Statement stmt = { nullptr, nullptr, 0 };
+    Token decl_type = { TOKEN_EOF, nullptr, 0, 0 };
+    unsigned ntokens = 0;
+    int depth = 0;
+
+    statements.clear();
+    declarations.clear();
+    pending.clear();
+    diag.clear();
+
+    for (;;) {
+        Token tok = lexer.next();
+
+        if (tok.type == TOKEN_ERROR) {
+            diag.error("line %u: bad input '%s'\n", tok.line, tok.text().c_str());
+            return false;
+        }
+
+        if (tok.type == TOKEN_EOF) {
+            /* a trailing statement without ';' is left for the parser */
+            if (ntokens) {
+                stmt.end = end;
+                statements.push_back(stmt);
+            }
+            return true;
+        }
+
+        if (ntokens == 0) {
+            stmt.begin = tok.start;
+            stmt.line = tok.line;
+        }
+
+        /* type IDENT at the start of a statement declares IDENT */
+        if (ntokens == 0 && is_type_keyword(tok))
+            decl_type = tok;
+        else if (ntokens == 1 && decl_type.start && tok.type == TOKEN_IDENT) {
+            std::string name = tok.text();
+            if (!declarations.count(name)) {
+                Declaration decl;
+                decl.type = decl_type.is("string") ? TYPE_STRING : TYPE_INT;
+                decl.statement = statements.size();
+                decl.preexisting = false;
+                decl.inherited = false;
+                decl.global = -1;
+                if (env) {
+                    decl.global = env->local_index(name);
+                    decl.preexisting = decl.global >= 0;
+                    Symbol *sym = decl.preexisting ? env->local(decl.global)
+                                                   : nullptr;
+                    if (sym && !symbol_value_type(sym, decl.type)) {
+                        diag.error("line %u: '%s' is a %s which cannot be "
+                                   "declared as %s\n", tok.line, name.c_str(),
+                                   symbol_type_name(sym),
+                                   decl_type.text().c_str());
+                    } else if (!decl.preexisting) {
+                        /* bound once the whole script has compiled */
+                        decl.global = env->local_count() + pending.size();
+                        pending.push_back(name);
+                    }
+                }
+                declarations[name] = decl;
+            }
+        }
+        ntokens++;
+
+        if (tok.type != TOKEN_OP)
+            continue;
+        /* only blocks may contain ';', a stray '(' can't swallow the rest */
+        if (tok.is("{"))
+            depth++;
+        else if (tok.is("}"))
+            depth--;
+        else if (tok.is(";") && depth <= 0) {
+            stmt.end = tok.start + 1;
+            statements.push_back(stmt);
+            decl_type.start = nullptr;
+            ntokens = 0;
+            depth = 0;
+        }
+    }
+}
+
+Expression*
+Compiler::compile_chunk (unsigned first, unsigned last,
+                         Diagnostics &chunk_diag) const
+{
+    Expression *expr = new Expression();
+    Parser parser(*this, *expr, chunk_diag);
+
+    for (unsigned i = first; i < last; i++)
+        parser.statement(i);
+    expr->finish();
+
+    return expr;
+}
+
+Expression*
+Compiler::compile (const char *begin, const char *end)
+{
+    if (!split(begin, end))
+        return nullptr;
+
+    unsigned count = statements.size();
+    unsigned chunks = (count + COMPILE_CHUNK - 1) / COMPILE_CHUNK;
+    std::vector<Expression*> modules(chunks, nullptr);
+    std::vector<Diagnostics> chunk_diags(chunks);
+    std::atomic<unsigned> next(0);
+
+    auto worker = [&] () {
+        for (unsigned c = next++; c < chunks; c = next++) {
+            unsigned last = std::min(count, (c + 1) * COMPILE_CHUNK);
+            modules[c] = compile_chunk(c * COMPILE_CHUNK, last, chunk_diags[c]);
+        }
+    };
+
+    unsigned nthreads = std::min(chunks, std::thread::hardware_concurrency());
+    std::vector<std::thread> pool;
+    for (unsigned i = 1; i < nthreads; i++)
+        pool.emplace_back(worker);
+    worker();
+    for (auto &thread : pool)
+        thread.join();
+
+    /* errors are reported in source order whichever thread found them */
+    for (auto &chunk : chunk_diags)
+        diag.append(chunk);
+    bool ok = diag.ok();
+
+    /*
+     * A global can't be unbound once it has been, so check all of them fit
+     * under the quotas before binding the first.
+     */
+    Symbol empty_string((String(std::string()))), zero(0);
+    unsigned long bytes = 0;
+    for (unsigned i = 0; ok && i < pending.size(); i++)
+        bytes += Environment::footprint(
+            declarations[pending[i]].type == TYPE_STRING ? &empty_string : &zero);
+    if (ok && bytes && !env->fits(bytes)) {
+        diag.error("out of memory binding %zu globals\n", pending.size());
+        ok = false;
+    }
+
+    /* globals are bound in the order their indices were handed out */
+    for (unsigned i = 0; ok && i < pending.size(); i++) {
+        const Declaration &decl = declarations[pending[i]];
+        int index = decl.type == TYPE_STRING ?
+            env->register_local(pending[i], std::string()) :
+            env->register_local(pending[i], 0);
+        if (index < 0) {
+            diag.error("out of memory binding '%s'\n", pending[i].c_str());
+            ok = false;
+            break;
+        }
+        assert(index == decl.global);
+    }
+
+    Expression *result = nullptr;
+    if (ok && chunks == 0) {
+        result = new Expression();
+        result->finish();
+    } else if (ok && chunks == 1) {
+        result = modules[0];
+        modules[0] = nullptr;
+    } else if (ok) {
+        Linker linker;
+        for (auto module : modules)
+            linker.add(*module);
+        result = new Expression(linker.link());
+    }
+
+    for (auto module : modules)
+        delete module;
+    return result;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "environment.hpp"
+#include "error.hpp"
+#include "expression.hpp"
+
+typedef enum _ValueType {
+    TYPE_INT,
+    TYPE_STRING,
+    TYPE_ERROR
+} ValueType;
+
+/* A top level statement, from its first token up to and including ';' */
+struct Statement {
+    const char *begin;
+    const char *end;
+    unsigned line;
+};
+
+/* A name declared by the script or already bound in the environment */
+struct Declaration {
+    ValueType type;
+    unsigned statement;  /* index of the declaring statement */
+    bool preexisting;    /* bound before this script, usable anywhere */
+    bool inherited;      /* bound by a parent of the environment */
+    int global;          /* index of the environment local or -1 */
+};
+
+/*
+ * The Compiler is the front end: it turns the text of a script into a single
+ * finished Expression.
+ *
+ * The input is first split into top level statements. This pass is cheap and
+ * sequential, it finds the statement boundaries and every declaration so
+ * each name can be checked against where it was declared. Statements are
+ * then grouped into chunks which are parsed and compiled on a pool of
+ * threads, each into its own Expression. Finally the chunks are linked back
+ * together in source order. Locals are merged by name and globals are bound
+ * during the sequential split so the result doesn't depend on the order the
+ * threads ran in.
+ *
+ * Given an Environment, declared names become globals in it so their values
+ * outlive the expression, and names it already binds may be used anywhere.
+ * Names only bound by its parents are resolved by name at run time through
+ * an inline cache.
+ * New globals are only bound if the whole script compiles. Without an
+ * Environment declared names are locals of the expression.
+ */
+class Compiler {
+public:
+    Compiler (Environment *env = nullptr);
+
+    /* compile the script, NULL if there were any errors */
+    Expression* compile (const char *begin, const char *end);
+
+    /* errors and warnings from the last compile in source order */
+    const Diagnostics& diagnostics () const;
+
+protected:
+    friend class Parser;
+
+    /* find statements and declarations, false on a lexical error */
+    bool split (const char *begin, const char *end);
+
+    /* compile statements [first, last) into a finished expression */
+    Expression* compile_chunk (unsigned first, unsigned last,
+                               Diagnostics &chunk_diag) const;
+
+    Environment *env;
+    std::vector<Statement> statements;
+    std::unordered_map<std::string, Declaration> declarations;
+
+    /* names which become new globals, in order of their indices */
+    std::vector<std::string> pending;
+
+    Diagnostics diag;
+};
@@ -0,0 +1,327 @@
+#include <algorithm>
+#include <assert.h>
+#include <unordered_map>
+#include <vector>
+#include "rope.hpp"
+
+/* concatenations and slices up to this long are copied into a new leaf */
+#define ROPE_FLAT_MAX 32
+
+typedef enum _RopeKind {
+    ROPE_LEAF,    /* owns its characters */
+    ROPE_CONCAT,  /* left followed by right */
+    ROPE_SLICE    /* length characters of base from start */
+} RopeKind;
+
+struct RopeNode {
+    unsigned refs;
+    RopeKind kind;
+    size_t length;
+    bool interned;
+
+    std::string bytes;
+    RopeNode *left;
+    RopeNode *right;
+    RopeNode *base;
+    size_t start;
+};
+
+/*
+ * Interned strings by their characters, the table holds one reference. Built
+ * on first use and never destroyed, like the environment roots, so strings
+ * with static storage in any file can be interned.
+ */
+static std::unordered_map<std::string, RopeNode*>&
+interned ()
+{
+    static auto *table = new std::unordered_map<std::string, RopeNode*>();
+    return *table;
+}
+
+static RopeNode*
+new_node (RopeKind kind, size_t length)
+{
+    RopeNode *node = new RopeNode;
+    node->refs = 1;
+    node->kind = kind;
+    node->length = length;
+    node->interned = false;
+    node->left = nullptr;
+    node->right = nullptr;
+    node->base = nullptr;
+    node->start = 0;
+    return node;
+}
+
+static RopeNode*
+new_leaf (const char *bytes, size_t len)
+{
+    RopeNode *node = new_node(ROPE_LEAF, len);
+    node->bytes.assign(bytes, len);
+    return node;
+}
+
+/*
+ * Append len characters of the node starting at start to out. Walks the rope
+ * with an explicit stack since long chains of concatenations are deep.
+ */
+static void
+gather (const RopeNode *node, size_t start, size_t len, std::string &out)
+{
+    struct Part { const RopeNode *node; size_t start; size_t len; };
+    std::vector<Part> parts;
+    parts.push_back({node, start, len});
+
+    while (!parts.empty()) {
+        Part p = parts.back();
+        parts.pop_back();
+        if (p.len == 0)
+            continue;
+
+        switch (p.node->kind) {
+            case ROPE_LEAF:
+                out.append(p.node->bytes, p.start, p.len);
+                break;
+
+            case ROPE_SLICE:
+                parts.push_back({p.node->base, p.node->start + p.start, p.len});
+                break;
+
+            case ROPE_CONCAT: {
+                size_t split = p.node->left->length;
+                /* right is pushed first so that left is gathered first */
+                if (p.start + p.len > split) {
+                    size_t rs = p.start > split ? p.start - split : 0;
+                    parts.push_back({p.node->right, rs, p.start + p.len - split - rs});
+                }
+                if (p.start < split) {
+                    size_t ll = std::min(p.len, split - p.start);
+                    parts.push_back({p.node->left, p.start, ll});
+                }
+                break;
+            }
+        }
+    }
+}
+
+RopeNode*
+String::retain (RopeNode *node)
+{
+    if (node)
+        node->refs++;
+    return node;
+}
+
+void
+String::release (RopeNode *node)
+{
+    std::vector<RopeNode*> dead;
+
+    if (node)
+        dead.push_back(node);
+
+    while (!dead.empty()) {
+        RopeNode *n = dead.back();
+        dead.pop_back();
+        assert(n->refs > 0);
+        if (--n->refs > 0)
+            continue;
+        if (n->left)  dead.push_back(n->left);
+        if (n->right) dead.push_back(n->right);
+        if (n->base)  dead.push_back(n->base);
+        delete n;
+    }
+}
+
+String::String ()
+    : root(nullptr)
+{ }
+
+String::String (const std::string &str)
+    : root(str.empty() ? nullptr : new_leaf(str.data(), str.size()))
+{ }
+
+String::String (const char *bytes, size_t len)
+    : root(len == 0 ? nullptr : new_leaf(bytes, len))
+{ }
+
+String::String (RopeNode *node)
+    : root(retain(node))
+{ }
+
+String::String (const String &other)
+    : root(retain(other.root))
+{ }
+
+String&
+String::operator= (const String &other)
+{
+    RopeNode *old = root;
+    root = retain(other.root);
+    release(old);
+    return *this;
+}
+
+String::~String ()
+{
+    release(root);
+}
+
+String
+String::intern (const std::string &str)
+{
+    if (str.empty())
+        return String();
+
+    auto it = interned().find(str);
+    if (it != interned().end())
+        return String(it->second);
+
+    RopeNode *node = new_leaf(str.data(), str.size());
+    node->interned = true;
+    interned()[str] = node;
+    return String(node);
+}
+
+String
+String::concat (const String &other) const
+{
+    if (!root)
+        return other;
+    if (!other.root)
+        return *this;
+
+    size_t len = root->length + other.root->length;
+    if (len <= ROPE_FLAT_MAX) {
+        std::string flat;
+        flat.reserve(len);
+        gather(root, 0, root->length, flat);
+        gather(other.root, 0, other.root->length, flat);
+        return String(flat);
+    }
+
+    RopeNode *node = new_node(ROPE_CONCAT, len);
+    node->left = retain(root);
+    node->right = retain(other.root);
+    String result(node);
+    release(node);
+    return result;
+}
+
+String
+String::slice (size_t start, size_t len) const
+{
+    size_t total = length();
+    if (start >= total || len == 0)
+        return String();
+    if (len > total - start)
+        len = total - start;
+    if (start == 0 && len == total)
+        return *this;
+
+    /* find the smallest node which covers the whole slice */
+    RopeNode *node = root;
+    while (true) {
+        if (node->kind == ROPE_SLICE) {
+            start += node->start;
+            node = node->base;
+        } else if (node->kind == ROPE_CONCAT) {
+            size_t split = node->left->length;
+            if (start + len <= split) {
+                node = node->left;
+            } else if (start >= split) {
+                start -= split;
+                node = node->right;
+            } else {
+                break;
+            }
+        } else {
+            break;
+        }
+    }
+
+    if (len <= ROPE_FLAT_MAX) {
+        std::string flat;
+        gather(node, start, len, flat);
+        return String(flat);
+    }
+
+    RopeNode *view = new_node(ROPE_SLICE, len);
+    view->base = retain(node);
+    view->start = start;
+    String result(view);
+    release(view);
+    return result;
+}
+
+size_t
+String::length () const
+{
+    return root ? root->length : 0;
+}
+
+char
+String::at (size_t index) const
+{
+    assert(index < length());
+    const RopeNode *node = root;
+    while (true) {
+        switch (node->kind) {
+            case ROPE_LEAF:
+                return node->bytes[index];
+
+            case ROPE_SLICE:
+                index += node->start;
+                node = node->base;
+                break;
+
+            case ROPE_CONCAT:
+                if (index < node->left->length) {
+                    node = node->left;
+                } else {
+                    index -= node->left->length;
+                    node = node->right;
+                }
+                break;
+        }
+    }
+}
+
+bool
+String::is_interned () const
+{
+    return root && root->interned;
+}
+
+std::string
+String::str () const
+{
+    std::string out;
+    if (root) {
+        out.reserve(root->length);
+        gather(root, 0, root->length, out);
+    }
+    return out;
+}
+
+bool
+String::operator== (const String &other) const
+{
+    if (root == other.root)
+        return true;
+    if (length() != other.length())
+        return false;
+    return str() == other.str();
+}
+
+bool
+String::operator!= (const String &other) const
+{
+    return !(*this == other);
+}
+
+RopeNode*
+String::node () const
+{
+    return root;
+}
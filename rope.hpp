@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+
+struct RopeNode;
+
+/*
+ * A String is an immutable, reference counted handle to a rope. Copying a
+ * String only bumps a count. Concatenating makes a node pointing at both
+ * halves and slicing makes a node pointing into the original, so neither
+ * copies any characters (very short results are just copied into a new leaf
+ * as that is cheaper than the nodes). The characters are only gathered when
+ * `str` is called.
+ *
+ * String literals are interned: every interned String with the same
+ * characters shares one node which is never freed.
+ *
+ * Reference counts are not atomic. Strings must not be shared between
+ * threads.
+ */
+class String {
+public:
+    /* the empty string */
+    String ();
+
+    /* a new heap string holding a copy of the characters */
+    String (const std::string &str);
+    String (const char *bytes, size_t len);
+
+    /* share an existing node */
+    explicit String (RopeNode *node);
+
+    String (const String &other);
+    String& operator= (const String &other);
+    ~String ();
+
+    /* the single shared string with these characters */
+    static String intern (const std::string &str);
+
+    /* a new string of this followed by other */
+    String concat (const String &other) const;
+
+    /* a view of len characters from start, clamped to the string's end */
+    String slice (size_t start, size_t len) const;
+
+    size_t length () const;
+    char at (size_t index) const;
+    bool is_interned () const;
+
+    /* gather the characters into a flat std::string */
+    std::string str () const;
+
+    bool operator== (const String &other) const;
+    bool operator!= (const String &other) const;
+
+    /* manual reference counting for holders of raw nodes, e.g. Symbols */
+    static RopeNode* retain (RopeNode *node);
+    static void release (RopeNode *node);
+    RopeNode* node () const;
+
+protected:
+    RopeNode *root;
+};
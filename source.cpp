@@ -0,0 +1,76 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "error.hpp"
+#include "source.hpp"
+
+Source::Source (std::istream &input)
+    : buffer((std::istreambuf_iterator<char>(input)),
+             std::istreambuf_iterator<char>())
+    , map(nullptr), length(buffer.size()), valid(true)
+{ }
+
+Source::Source (const std::string &path, Diagnostics &diag)
+    : map(nullptr), length(0), valid(false)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        diag.error("cannot open %s\n", path.c_str());
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        diag.error("cannot read %s\n", path.c_str());
+        return;
+    }
+
+    /* an empty file can't be mapped but is still a perfectly good file */
+    if (st.st_size > 0) {
+        map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            map = nullptr;
+            close(fd);
+            diag.error("cannot map %s\n", path.c_str());
+            return;
+        }
+        /* scripts are lexed front to back exactly once */
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        length = st.st_size;
+    }
+
+    close(fd);
+    valid = true;
+}
+
+Source::~Source ()
+{
+    if (map)
+        munmap(map, length);
+}
+
+bool
+Source::ok () const
+{
+    return valid;
+}
+
+const char*
+Source::begin () const
+{
+    return map ? (const char*) map : buffer.data();
+}
+
+const char*
+Source::end () const
+{
+    return begin() + length;
+}
+
+size_t
+Source::size () const
+{
+    return length;
+}
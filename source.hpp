@@ -0,0 +1,37 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include "error.hpp"
+
+/*
+ * The text of a script. Files are memory mapped so even very large scripts
+ * are never copied, tokens point straight into the mapping. Streams, like
+ * stdin, can't be mapped and are read into a buffer instead.
+ */
+class Source {
+public:
+    /* read the whole stream */
+    Source (std::istream &input);
+
+    /* map the file at path, a failure is reported to diag */
+    Source (const std::string &path, Diagnostics &diag);
+
+    ~Source ();
+
+    Source (const Source &other) = delete;
+    Source& operator= (const Source &other) = delete;
+
+    /* false if the file couldn't be opened or mapped */
+    bool ok () const;
+
+    const char* begin () const;
+    const char* end () const;
+    size_t size () const;
+
+protected:
+    std::string buffer;
+    void *map;
+    size_t length;
+    bool valid;
+};
@@ -1,6 +1,9 @@
 #pragma once
 
 #include "expression.hpp"
+#include "function.hpp"
+#include "layout.hpp"
+#include "rope.hpp"
 #include <assert.h>
 
 /*
@@ -36,14 +39,16 @@ public:
         set(0, value);
     }
 
+    /*
+     * Structure types, e.g. { int, void*, int[10] }, are described by a
+     * Layout which computes how many bytes a chunk of them needs and the
+     * offsets of each field. The stride is the distance between records, or
+     * 0 for a structure of arrays where every column has its own.
+     */
     Storage (const unsigned size, const unsigned stride)
+        : stride(stride)
     {
         resize(size);
-
-        /* 
-         * TODO: figure out how to create structure types 
-         * e.g { int, void*, int[10] }
-         */
     }
 
     void
@@ -105,6 +110,36 @@ public:
         *(reinterpret_cast<void**>(&container[0] + index)) = val;
     }
 
+    /*
+     * Raw access to the bytes of the container, e.g. for copying whole blocks
+     * of memory in and out of a symbol.
+     */
+
+    unsigned
+    bytes () const
+    {
+        return container.size();
+    }
+
+    const Byte*
+    data () const
+    {
+        return container.data();
+    }
+
+    Byte*
+    data ()
+    {
+        return container.data();
+    }
+
+    /* distance between the records of a chunk, 0 for a structure of arrays */
+    unsigned
+    record_stride () const
+    {
+        return stride;
+    }
+
 protected:
     /*
      * Guaranteed by the standard to have contiguous memory blocks. Therefore
@@ -120,7 +155,8 @@ typedef enum _SymbolType {
     DOUBLE,
     REFERENCE,
     FUNCTION,
-    CHUNK        /* contiguous block of memory */
+    CHUNK,       /* contiguous block of memory */
+    STRING       /* immutable, reference counted String */
 } SymbolType;
 
 /*
@@ -134,37 +170,101 @@ public:
         : symtype(INTEGER)
         , storage(Storage(val))
         , was_allocated(false)
+        , marked(0)
     { }
 
     Symbol (double val)
         : symtype(DOUBLE)
         , storage(Storage(val))
         , was_allocated(false)
+        , marked(0)
     { }
 
     Symbol (Symbol *val)
         : symtype(REFERENCE)
         , storage(Storage(val))
         , was_allocated(false)
+        , marked(0)
     { }
 
     Symbol (Expression *val)
         : symtype(FUNCTION)
-        , storage(Storage(val))
+        , storage(Storage((void*) (val ? Function::retain(new Function(val))
+                                       : nullptr)))
+        , was_allocated(false)
+        , marked(0)
+    { }
+
+    Symbol (Function *val)
+        : symtype(FUNCTION)
+        , storage(Storage((void*) Function::retain(val)))
         , was_allocated(false)
+        , marked(0)
     { }
 
     Symbol (unsigned size, unsigned stride)
         : symtype(CHUNK)
         , storage(Storage(size, stride))
         , was_allocated(false)
+        , marked(0)
+    { }
+
+    Symbol (const Layout &layout, unsigned records, LayoutMode mode)
+        : symtype(CHUNK)
+        , storage(Storage(layout.bytes(records, mode),
+                          mode == LAYOUT_AOS ? layout.size() : 0))
+        , was_allocated(false)
+        , marked(0)
+    { }
+
+    Symbol (const String &val)
+        : symtype(STRING)
+        , storage(Storage((void*) String::retain(val.node())))
+        , was_allocated(false)
+        , marked(0)
     { }
 
     Symbol (const Symbol &other, bool was_allocated)
         : symtype(other.symtype)
         , storage(other.storage)
         , was_allocated(was_allocated)
-    { }
+        , marked(0)
+    {
+        retain();
+    }
+
+    /*
+     * Strings and functions are the only symbols which hold a reference to
+     * something they share, so copying and destroying symbols keeps their
+     * counts right.
+     */
+
+    Symbol (const Symbol &other)
+        : symtype(other.symtype)
+        , storage(other.storage)
+        , was_allocated(other.was_allocated)
+        , marked(0)
+    {
+        retain();
+    }
+
+    Symbol&
+    operator= (const Symbol &other)
+    {
+        if (this != &other) {
+            release();
+            symtype = other.symtype;
+            storage = other.storage;
+            was_allocated = other.was_allocated;
+            retain();
+        }
+        return *this;
+    }
+
+    ~Symbol ()
+    {
+        release();
+    }
 
     /* 
      * Create a new Symbol that's a clone of this one. This is how to allocate
@@ -182,6 +282,24 @@ public:
         return was_allocated;
     }
 
+    /*
+     * Mark for the collector, the cycle in which the symbol was last reached
+     * from some Environment. Cycles count up from 1, so a symbol marked in an
+     * earlier cycle never needs its mark cleared, wherever it lives.
+     */
+
+    bool
+    is_marked (unsigned long cycle) const
+    {
+        return marked == cycle;
+    }
+
+    void
+    mark (unsigned long cycle)
+    {
+        marked = cycle;
+    }
+
     SymbolType
     type () const
     {
@@ -204,12 +322,6 @@ public:
         return storage.floating_at(index);
     }
 
-    Expression*
-    expr_at (unsigned index) const
-    { 
-        return (Expression*) storage.ptr_at(index);
-    }
-
     Symbol*
     ref_at (unsigned index) const
     { 
@@ -234,11 +346,19 @@ public:
         return floating_at(0);
     }
 
+    /* the function's body, a stub is compiled on the first call */
     Expression*
     expr () const
+    {
+        Function *fn = function();
+        return fn ? fn->body() : nullptr;
+    }
+
+    Function*
+    function () const
     {
         assert(symtype == FUNCTION);
-        return expr_at(0);
+        return (Function*) storage.ptr_at(0);
     }
 
     Symbol*
@@ -248,6 +368,13 @@ public:
         return ref_at(0);
     }
 
+    String
+    string () const
+    {
+        assert(symtype == STRING);
+        return String((RopeNode*) storage.ptr_at(0));
+    }
+
     /* 
      * Only accept indexes > 0 if the type is a chunk.
      */
@@ -266,15 +393,72 @@ public:
         storage.set(index, val);
     }
 
+    /* strings and functions are counted, they can't be set as pointers */
     void
     set (unsigned index, void *val)
     {
         assert(index == 0 || (index >= 0 && symtype == CHUNK));
+        assert(symtype != STRING && symtype != FUNCTION);
         storage.set(index, val);
     }
 
+    unsigned
+    bytes () const
+    {
+        return storage.bytes();
+    }
+
+    const Byte*
+    data () const
+    {
+        return storage.data();
+    }
+
+    Byte*
+    data ()
+    {
+        return storage.data();
+    }
+
+    unsigned
+    record_stride () const
+    {
+        return storage.record_stride();
+    }
+
 protected:
+    void
+    retain ()
+    {
+        if (symtype == STRING)
+            String::retain((RopeNode*) storage.ptr_at(0));
+        else if (symtype == FUNCTION)
+            Function::retain((Function*) storage.ptr_at(0));
+    }
+
+    void
+    release ()
+    {
+        if (symtype == STRING)
+            String::release((RopeNode*) storage.ptr_at(0));
+        else if (symtype == FUNCTION)
+            Function::release((Function*) storage.ptr_at(0));
+    }
+
     SymbolType symtype;
     Storage storage;
     bool was_allocated;
+    unsigned long marked;
+
+private:
+    /* only Environment::resize_chunk, which charges for the bytes */
+    friend class Environment;
+
+    /* grow or shrink a chunk, new bytes are zeroed */
+    void
+    resize (unsigned num_bytes)
+    {
+        assert(symtype == CHUNK);
+        storage.resize(num_bytes);
+    }
 };
@@ -6,6 +6,13 @@ declare -a tests=(
     "8 - 10 + 4;"
     "int a = 14; int b = 18; 3 * a / 2 - b;"
     "int a = 4 - (4 * 2); 0 - a;"
+    # far more statements than the stack has slots, only the last is kept
+    "$(printf '1; %.0s' {1..300}) 5;"
+    # unary minus
+    "0 - -6;"
+    "-(2 + 3) + 12;"
+    "3 - -5;"
+    "int q = -9; -q;"
 )
 
 #declare -a tests=(
@@ -36,13 +43,16 @@ declare -a tests=(
 
 len=${#tests[@]}
 
-for ((i=1; i < ${len} + 1; i++)); do
-    in=${tests[$i - 1]}
-    out=`echo "$in" | ./lang -`
-    if [[ $i != $out ]]; then
-        echo "Test \`$in\` failed: $i != $out"
-        exit 1
-    fi
+# every interpreter has to give the same answers
+for tier in switch cached thunks; do
+    for ((i=1; i < ${len} + 1; i++)); do
+        in=${tests[$i - 1]}
+        out=`echo "$in" | ./lang -t $tier -`
+        if [[ $i != $out ]]; then
+            echo "Test \`$in\` failed ($tier): $i != $out"
+            exit 1
+        fi
+    done
 done
 
 echo "All Tests Passed!"
@@ -0,0 +1,111 @@
+#include <limits.h>
+#include <math.h>
+#include "bulk.hpp"
+#include "tests/check.hpp"
+
+/* wrapping reference arithmetic, the kernels must agree exactly */
+static int
+wrap_add (int a, int b)
+{
+    return (int) ((unsigned) a + (unsigned) b);
+}
+
+static int
+wrap_mul (int a, int b)
+{
+    return (int) ((unsigned) a * (unsigned) b);
+}
+
+static void
+check_kernels (unsigned n)
+{
+    Symbol a(n * sizeof(int), sizeof(int));
+    Symbol b(n * sizeof(int), sizeof(int));
+    Symbol d(n * sizeof(int), sizeof(int));
+    Symbol x(n * sizeof(double), sizeof(double));
+    Symbol y(n * sizeof(double), sizeof(double));
+    Symbol z(n * sizeof(double), sizeof(double));
+
+    int64_t sum = 0;
+    uint64_t dot = 0;
+    int lo = INT_MAX, hi = INT_MIN;
+    for (unsigned i = 0; i < n; i++) {
+        /* large values overflow both the sums and the products */
+        int va = (i % 3 == 0) ? INT_MAX - (int) i : (int) i * 7 - 40;
+        int vb = (i % 4 == 1) ? INT_MIN + (int) i : 3 - (int) i;
+        a.set(i * sizeof(int), va);
+        b.set(i * sizeof(int), vb);
+        x.set(i * sizeof(double), i * 0.5 - 3);
+        y.set(i * sizeof(double), 2.0);
+        sum += va;
+        dot += (uint64_t) ((int64_t) va * vb);
+        lo = va < lo ? va : lo;
+        hi = va > hi ? va : hi;
+    }
+
+    bulk_addi(d, 0, a, 0, b, 0, n);
+    for (unsigned i = 0; i < n; i++)
+        CHECK(d.integer_at(i * sizeof(int))
+              == wrap_add(a.integer_at(i * sizeof(int)),
+                          b.integer_at(i * sizeof(int))));
+    bulk_muli(d, 0, a, 0, b, 0, n);
+    for (unsigned i = 0; i < n; i++)
+        CHECK(d.integer_at(i * sizeof(int))
+              == wrap_mul(a.integer_at(i * sizeof(int)),
+                          b.integer_at(i * sizeof(int))));
+    bulk_cmpi(BIN_CMPLT, d, 0, a, 0, b, 0, n);
+    for (unsigned i = 0; i < n; i++)
+        CHECK(d.integer_at(i * sizeof(int))
+              == (a.integer_at(i * sizeof(int)) < b.integer_at(i * sizeof(int))));
+
+    CHECK(bulk_sumi(a, 0, n) == sum);
+    CHECK(bulk_doti(a, 0, b, 0, n) == (int64_t) dot);
+    if (n > 0) {
+        CHECK(bulk_mini(a, 0, n) == lo);
+        CHECK(bulk_maxi(a, 0, n) == hi);
+        CHECK(bulk_mind(x, 0, n) == -3);
+        CHECK(bulk_maxd(x, 0, n) == (n - 1) * 0.5 - 3);
+    }
+
+    bulk_muld(z, 0, x, 0, y, 0, n);
+    bulk_addd(z, 0, z, 0, x, 0, n);
+    for (unsigned i = 0; i < n; i++)
+        CHECK(z.floating_at(i * sizeof(double)) == 3 * (i * 0.5 - 3));
+    CHECK(bulk_dotd(x, 0, y, 0, n) == 2 * bulk_sumd(x, 0, n));
+
+    /* a NaN anywhere is the min and max, wherever a lane puts it */
+    for (unsigned at = 0; at < n; at++) {
+        double was = x.floating_at(at * sizeof(double));
+        x.set(at * sizeof(double), NAN);
+        CHECK(isnan(bulk_mind(x, 0, n)));
+        CHECK(isnan(bulk_maxd(x, 0, n)));
+        x.set(at * sizeof(double), was);
+    }
+}
+
+int
+main ()
+{
+    const char *sets[] = { "scalar", "sse2", "avx2" };
+    for (const char *isa : sets) {
+        if (!bulk_use(isa))
+            continue;
+        CHECK(std::string(bulk_isa()) == isa);
+        for (unsigned n = 0; n <= 37; n++)
+            check_kernels(n);
+    }
+
+    /* the kernels work on columns of a structure of arrays too */
+    Layout layout;
+    unsigned f = layout.add(FIELD_INT);
+    unsigned g = layout.add(FIELD_DOUBLE);
+    Symbol soa(layout, 10, LAYOUT_SOA);
+    for (unsigned r = 0; r < 10; r++) {
+        soa.set(layout.offset(r, f, 0, 10, LAYOUT_SOA), (int) r);
+        soa.set(layout.offset(r, g, 0, 10, LAYOUT_SOA), r * 2.0);
+    }
+    CHECK(bulk_sumi(soa, layout.offset(0, f, 0, 10, LAYOUT_SOA), 10) == 45);
+    CHECK(bulk_maxd(soa, layout.offset(0, g, 0, 10, LAYOUT_SOA), 10) == 18);
+
+    return check_result("bulk_test");
+}
@@ -0,0 +1,63 @@
+#include "cache.hpp"
+#include "tests/check.hpp"
+
+static Expression*
+constant (int value)
+{
+    Expression *expr = new Expression();
+    expr->push_constant(value);
+    expr->finish();
+    return expr;
+}
+
+static Expression*
+find (ExpressionCache &cache, const char *source)
+{
+    return cache.find(ExpressionCache::key(source));
+}
+
+int
+main ()
+{
+    /* whitespace and comments don't matter, string literals do */
+    CHECK(ExpressionCache::normalize("  1 +\n\t2 ; ") == "1 + 2 ;");
+    CHECK(ExpressionCache::normalize("1/* one */+/**/2;") == "1 + 2;");
+    CHECK(ExpressionCache::normalize("\"a  /* b */\";") == "\"a  /* b */\";");
+    CHECK(ExpressionCache::normalize("\"a\\\"  b\"  ;") == "\"a\\\"  b\" ;");
+    CHECK(ExpressionCache::key("1 + 2;").hash ==
+          ExpressionCache::key("1  +  2;  /* again */").hash);
+
+    /* a miss, then hits on anything normalizing the same */
+    ExpressionCache cache(2);
+    CHECK(find(cache, "1;") == nullptr);
+    Expression *one = constant(1);
+    CHECK(cache.insert(ExpressionCache::key("1;"), one) == one);
+    CHECK(find(cache, "1;") == one);
+    CHECK(find(cache, "\n 1;  /* same */") == one);
+    CHECK(find(cache, "\"1;\"") == nullptr);
+    CHECK(cache.stats().hits == 2);
+    CHECK(cache.stats().misses == 2);
+
+    /* inserting the same source again replaces what was there */
+    Expression *again = constant(1);
+    cache.insert(ExpressionCache::key("1;"), again);
+    CHECK(cache.size() == 1);
+    CHECK(find(cache, "1;") == again);
+
+    /* the least recently used goes first, and finding one counts as a use */
+    Expression *two = constant(2);
+    cache.insert(ExpressionCache::key("2;"), two);
+    CHECK(find(cache, "1;") == again);
+    cache.insert(ExpressionCache::key("3;"), constant(3));
+    CHECK(cache.size() == 2);
+    CHECK(cache.stats().evictions == 1);
+    CHECK(find(cache, "2;") == nullptr);
+    CHECK(find(cache, "1;") == again);
+    cache.insert(ExpressionCache::key("4;"), constant(4));
+    CHECK(find(cache, "3;") == nullptr);
+    CHECK(find(cache, "1;") == again);
+    CHECK(find(cache, "4;") != nullptr);
+    CHECK(cache.stats().evictions == 2);
+
+    return check_result("cache_test");
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdio.h>
+#include <sstream>
+#include <string>
+#include "machine.hpp"
+
+/*
+ * The smallest possible test harness. CHECK reports a failed condition and
+ * carries on so one run shows every failure, then the test's main returns
+ * check_result() which is non-zero if anything failed.
+ */
+static unsigned check_failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", \
+                __FILE__, __LINE__, #cond); \
+        check_failures++; \
+    } \
+} while (0)
+
+static inline int
+check_result (const char *name)
+{
+    if (check_failures)
+        fprintf(stderr, "%s: %u checks failed\n", name, check_failures);
+    else
+        printf("%s: passed\n", name);
+    return check_failures ? 1 : 0;
+}
+
+/* what evaluating expr prints, or its trap */
+static inline std::string
+run (Expression &expr)
+{
+    std::ostringstream out;
+    Result result = evaluate(expr, out);
+    return result.ok ? out.str() : "trap: " + result.trap;
+}
+
+/* the same for a function's body, which may have failed to compile */
+static inline std::string
+run (Expression *expr)
+{
+    return expr ? run(*expr) : "no body";
+}
+
+/* run in every tier, which must all agree */
+static inline std::string
+run_tiers (Expression &expr)
+{
+    std::ostringstream a, b, c;
+    Compiled compiled(expr);
+    Result ra = evaluate(expr, a);
+    Result rb = evaluate_cached(expr, b);
+    Result rc = evaluate(compiled, c);
+    CHECK(ra.ok == rb.ok && rb.ok == rc.ok);
+    CHECK(ra.trap == rb.trap && rb.trap == rc.trap);
+    CHECK(a.str() == b.str() && b.str() == c.str());
+    return ra.ok ? a.str() : "trap: " + ra.trap;
+}
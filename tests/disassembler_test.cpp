@@ -0,0 +1,115 @@
+#include <sstream>
+#include "disassembler.hpp"
+#include "encoding.hpp"
+#include "machine.hpp"
+#include "tests/check.hpp"
+
+static std::string
+listing (const Expression &expr)
+{
+    std::ostringstream out;
+    Disassembler::print(expr, out);
+    return out.str();
+}
+
+/* the listed line of the instruction at pc */
+static std::string
+line_at (const std::string &text, unsigned pc)
+{
+    char prefix[16];
+    snprintf(prefix, sizeof(prefix), "\n  %04u  ", pc);
+    size_t start = text.find(prefix);
+    if (start == std::string::npos)
+        return "";
+    start++;
+    return text.substr(start, text.find('\n', start) - start);
+}
+
+static bool
+ends_with (const std::string &str, const std::string &suffix)
+{
+    return str.size() >= suffix.size() &&
+        str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+int
+main ()
+{
+    /* straight line code costs the sum of its instructions */
+    Expression sum;
+    sum.load_global(0);
+    sum.load_global(1);
+    sum.addi();
+    sum.finish();
+    unsigned long cost = 0;
+    for (auto ins : sum.code())
+        cost += Disassembler::info(get_opcode(ins)).cost;
+    CHECK(Disassembler::cost(sum) == cost);
+    CHECK(ends_with(line_at(listing(sum), 1), "depth 2"));
+
+    /* long operands are listed whole */
+    std::string name(200, 'n');
+    Expression named;
+    named.load_name(name);
+    named.finish();
+    CHECK(listing(named).find(name) != std::string::npos);
+    std::string text;
+
+    /* notes line up however many digits the immediates take */
+    Expression wide;
+    for (int i = 0; i < 150; i++)
+        wide.push_constant(1000 + i);
+    wide.finish();
+    text = listing(wide);
+    std::string near = line_at(text, wide.body());
+    std::string far = line_at(text, wide.code().size() - 2);
+    CHECK(near.find(';') != std::string::npos);
+    CHECK(near.find(';') == far.find(';'));
+    CHECK(near.find("cost") == far.find("cost"));
+
+    /*
+     * Branches can only be built by decoding:
+     *
+     *   0  loadg 0
+     *   1  ifeq  -> 4
+     *   2  loadg 0
+     *   3  j     -> 5
+     *   4  loadg 0
+     *   5  halt
+     *   6  loadg 0     never reached
+     *   7  halt
+     */
+    Expression empty;
+    empty.finish();
+    std::vector<uint8_t> bytes = Encoding::encode(empty);
+    bytes.resize(3);
+    bytes.insert(bytes.end(), { 0, 0, 0, 8 });
+    struct { Opcode op; int32_t imm; } program[] = {
+        { OP_LOADG, 0 }, { OP_IFEQ, 3 }, { OP_LOADG, 0 }, { OP_JMP, 2 },
+        { OP_LOADG, 0 }, { OP_HALT, 0 }, { OP_LOADG, 0 }, { OP_HALT, 0 },
+    };
+    for (auto &ins : program) {
+        bytes.push_back(ins.op);
+        if (Encoding::has_operand(ins.op))
+            bytes.push_back((uint32_t) ins.imm << 1);
+    }
+    Expression branches;
+    CHECK(Encoding::decode(bytes.data(), bytes.size(), branches));
+
+    /* both sides of the branch arrive at the same depth */
+    text = listing(branches);
+    CHECK(ends_with(line_at(text, 1), "depth 0"));
+    CHECK(ends_with(line_at(text, 3), "depth 1"));
+    CHECK(ends_with(line_at(text, 4), "depth 1"));
+    CHECK(ends_with(line_at(text, 5), "depth 1"));
+    CHECK(ends_with(line_at(text, 6), "depth -"));
+    CHECK(text.find("max depth 1") != std::string::npos);
+
+    /* unreachable code costs nothing */
+    cost = 0;
+    for (unsigned pc = 0; pc < 6; pc++)
+        cost += Disassembler::info(program[pc].op).cost;
+    CHECK(Disassembler::cost(branches) == cost);
+
+    return check_result("disassembler_test");
+}
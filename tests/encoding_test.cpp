@@ -0,0 +1,116 @@
+#include "encoding.hpp"
+#include "machine.hpp"
+#include "tests/check.hpp"
+
+static bool
+decodes (const std::vector<uint8_t> &bytes)
+{
+    Expression expr;
+    return Encoding::decode(bytes.data(), bytes.size(), expr);
+}
+
+int
+main ()
+{
+    /* (x = 1000000) then x * 3 - 7, plus a name and a wide constant */
+    Expression expr;
+    expr.push_constant(1000000);
+    expr.store_local("x");
+    expr.push_constant((int64_t) 1 << 50);
+    expr.load_name("n");
+    expr.store_name("n");
+    expr.store_local("wide");
+    expr.load_local("x");
+    expr.push_constant(3);
+    expr.muli();
+    expr.push_constant(-7);
+    expr.addi();
+    expr.finish();
+
+    std::vector<uint8_t> bytes = Encoding::encode(expr);
+    CHECK(bytes.size() < expr.code().size() * sizeof(Instruction));
+
+    Expression decoded;
+    CHECK(Encoding::decode(bytes.data(), bytes.size(), decoded));
+    CHECK(decoded.code() == expr.code());
+    CHECK(decoded.entry() == expr.entry());
+    CHECK(decoded.body() == expr.body());
+    CHECK(decoded.get_local("x") == expr.get_local("x"));
+    CHECK(decoded.get_local("wide") == expr.get_local("wide"));
+    CHECK(decoded.name_count() == 2);
+    CHECK(decoded.name_cache(1)->name == "n");
+    CHECK(decoded.result_kind() == expr.result_kind());
+    /* locals are kept in a hash table, so only their order may change */
+    std::vector<uint8_t> again = Encoding::encode(decoded);
+    Expression twice;
+    CHECK(again.size() == bytes.size());
+    CHECK(Encoding::decode(again.data(), again.size(), twice));
+    CHECK(twice.code() == expr.code());
+
+    /* the encoding is only the code, so leave out what needs an env */
+    Expression plain;
+    plain.push_constant(6);
+    plain.store_local("a");
+    plain.load_local("a");
+    plain.push_constant(7);
+    plain.muli();
+    plain.finish();
+    std::vector<uint8_t> small = Encoding::encode(plain);
+    Expression back;
+    CHECK(Encoding::decode(small.data(), small.size(), back));
+    CHECK(run(back) == "42\n");
+    CHECK(run(back) == run(plain));
+
+    /* instructions without an operand are a single byte, OP_POP included */
+    Expression popped;
+    popped.push_constant(1);
+    popped.pop();
+    popped.push_constant(2);
+    popped.finish();
+    Expression unpopped;
+    unpopped.push_constant(1);
+    unpopped.push_constant(2);
+    unpopped.finish();
+    CHECK(!Encoding::has_operand(OP_POP));
+    std::vector<uint8_t> pop = Encoding::encode(popped);
+    CHECK(pop.size() == Encoding::encode(unpopped).size() + 1);
+    CHECK(Encoding::decode(pop.data(), pop.size(), back));
+    CHECK(back.code() == popped.code());
+
+    /* every truncation is caught, as is anything left over */
+    for (size_t len = 0; len < bytes.size(); len++)
+        CHECK(!decodes(std::vector<uint8_t>(bytes.begin(), bytes.begin() + len)));
+    std::vector<uint8_t> longer = bytes;
+    longer.push_back(0);
+    CHECK(!decodes(longer));
+
+    /* a bad header */
+    std::vector<uint8_t> bad = bytes;
+    bad[0] ^= 0xFF;
+    CHECK(!decodes(bad));
+    bad = bytes;
+    bad[1]++;
+    CHECK(!decodes(bad));
+    bad = bytes;
+    bad[2] = 0x7F;
+    CHECK(!decodes(bad));
+
+    /* counts far beyond the data and varints which never end */
+    std::vector<uint8_t> huge = { bytes[0], bytes[1], bytes[2],
+                                  0xFF, 0xFF, 0xFF, 0xFF, 0x0F };
+    CHECK(!decodes(huge));
+    std::vector<uint8_t> endless = { bytes[0], bytes[1], bytes[2],
+                                     0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x01 };
+    CHECK(!decodes(endless));
+
+    /* damage anywhere either decodes to something or fails, never crashes */
+    for (size_t i = 3; i < bytes.size(); i++) {
+        for (uint8_t flip : { 0x01, 0x80, 0xFF }) {
+            std::vector<uint8_t> damaged = bytes;
+            damaged[i] ^= flip;
+            decodes(damaged);
+        }
+    }
+
+    return check_result("encoding_test");
+}
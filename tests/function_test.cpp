@@ -0,0 +1,87 @@
+#include "environment.hpp"
+#include "symbol.hpp"
+#include "machine.hpp"
+#include "tests/check.hpp"
+
+int
+main ()
+{
+    Environment root;
+    root.register_local("base", 40);
+    root.register_function("answer", "base + 2;");
+    root.register_function("broken", "1 + ;");
+    bind_environment(&root);
+
+    /* a stub isn't compiled until its body is asked for */
+    Function *answer = root.lookup("answer")->function();
+    CHECK(answer->is_stub());
+    CHECK(!answer->is_compiled());
+    CHECK(answer->source() == "base + 2;");
+    CHECK(answer->environment() == &root);
+
+    /* it is compiled against its environment exactly once */
+    Expression *body = answer->body();
+    CHECK(body != nullptr);
+    CHECK(answer->is_compiled() && !answer->is_stub());
+    CHECK(answer->source().empty());
+    CHECK(answer->body() == body);
+    CHECK(run(root.lookup("answer")->expr()) == "42\n");
+
+    /* a stub which can't compile keeps its errors and never tries again */
+    Function *broken = root.lookup("broken")->function();
+    CHECK(broken->body() == nullptr);
+    CHECK(broken->diagnostics().errors() > 0);
+    CHECK(broken->source() == "1 + ;");
+    unsigned errors = broken->diagnostics().errors();
+    CHECK(broken->body() == nullptr);
+    CHECK(broken->diagnostics().errors() == errors);
+    CHECK(run(root.lookup("broken")->expr()) == "no body");
+
+    /* a body which was given and not owned outlives the function */
+    Expression given;
+    given.push_constant(7);
+    given.finish();
+    {
+        Symbol sym(&given);
+        CHECK(sym.function()->is_compiled());
+        CHECK(!sym.function()->is_stub());
+        CHECK(sym.expr() == &given);
+    }
+    CHECK(run(&given) == "7\n");
+
+    /* a function lives as long as anything holds it */
+    Function *shared = Function::retain(new Function(&given));
+    {
+        Symbol a(shared);
+        Symbol b(shared);
+        CHECK(a.expr() == b.expr());
+    }
+    CHECK(shared->body() == &given);
+    Function::release(shared);
+    CHECK(run(&given) == "7\n");
+
+    /* a stub outliving its environment fails rather than compiling */
+    Environment *gone = new Environment();
+    gone->register_function("later", "1;");
+    Function *later = Function::retain(gone->lookup("later")->function());
+    delete gone;
+    CHECK(later->environment() == nullptr);
+    CHECK(later->body() == nullptr);
+    CHECK(later->diagnostics().errors() == 1);
+    Function::release(later);
+
+    /* a function is charged once however many symbols hold it */
+    Environment holder;
+    Function *twice = new Function("2;", &holder);
+    Symbol held(twice);
+    unsigned long used = holder.bytes_used();
+    CHECK(holder.take_symbol(held.allocate()));
+    unsigned long one = holder.bytes_used() - used;
+    CHECK(one == Environment::footprint(&held) + twice->bytes());
+    CHECK(holder.take_symbol(held.allocate()));
+    CHECK(holder.bytes_used() - used == one + Environment::footprint(&held));
+    Environment::collect();
+    CHECK(holder.bytes_used() == used);
+
+    return check_result("function_test");
+}
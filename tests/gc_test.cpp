@@ -0,0 +1,79 @@
+#include "environment.hpp"
+#include "tests/check.hpp"
+
+/* add_local takes any allocated symbol, a REFERENCE included */
+struct RefEnvironment : Environment {
+    using Environment::add_local;
+};
+
+static unsigned long
+freed ()
+{
+    return Environment::collector_stats().freed;
+}
+
+int
+main ()
+{
+    Environment env;
+    env.register_local("kept", 1);
+    env.add_child()->register_local("nested", 2);
+    Environment::collect();
+    unsigned long live = Environment::collector_stats().live;
+    CHECK(live == 2);
+
+    /* taken but never bound, so nothing reaches it */
+    Symbol *orphan = Symbol(3).allocate();
+    CHECK(env.take_symbol(orphan));
+    unsigned long before = freed();
+    Environment::collect();
+    CHECK(freed() == before + 1);
+    CHECK(Environment::collector_stats().live == live);
+    CHECK(env.bytes_used() ==
+          2 * (sizeof(Environment) + sizeof(Symbol) + sizeof(int)));
+
+    /* everything of a destroyed root goes once it's unreachable */
+    Environment *temp = new Environment();
+    temp->register_local("a", 5);
+    temp->add_child()->register_local("b", 6);
+    Environment::collect();
+    CHECK(Environment::collector_stats().live == live + 2);
+    before = freed();
+    delete temp;
+    Environment::collect();
+    CHECK(freed() == before + 2);
+    CHECK(Environment::collector_stats().live == live);
+
+    /* an incremental cycle, symbols taken halfway through survive it */
+    for (int i = 0; i < 10; i++)
+        env.take_symbol(Symbol(i).allocate());
+    before = freed();
+    CHECK(!Environment::collect_step(4));
+    Symbol *late = Symbol(7).allocate();
+    CHECK(env.take_symbol(late));
+    unsigned steps = 1;
+    while (!Environment::collect_step(4))
+        steps++;
+    CHECK(steps > 1);
+    CHECK(freed() == before + 10);
+    CHECK(Environment::collector_stats().live == live + 1);
+    Environment::collect();
+    CHECK(freed() == before + 11);
+
+    /*
+     * A symbol reached through one outside the collector's list, here on the
+     * stack, is kept by every cycle and not only the first.
+     */
+    RefEnvironment refs;
+    Symbol *target = Symbol(8).allocate();
+    CHECK(refs.take_symbol(target));
+    Symbol between(target);
+    CHECK(refs.add_local("r", Symbol(&between).allocate()) == 0);
+    before = freed();
+    Environment::collect();
+    Environment::collect();
+    CHECK(freed() == before);
+    CHECK(target->integer() == 8);
+
+    return check_result("gc_test");
+}
@@ -0,0 +1,87 @@
+#include <unistd.h>
+#include "image.hpp"
+#include "machine.hpp"
+#include "tests/check.hpp"
+
+static unsigned long
+live_symbols ()
+{
+    Environment::collect();
+    return Environment::collector_stats().live;
+}
+
+int
+main ()
+{
+    Environment env;
+    env.register_constant(42);
+    env.register_local("count", 7);
+    env.register_local("ratio", 0.5f);
+    env.register_local("name", std::string("image"));
+    env.register_constant(std::string("literal"));
+    env.register_chunk("block", 16, 4);
+    env.register_function("five", "2 + 3;");
+    env.register_function("later", "10 - 4;");
+    env.add_child()->register_local("inner", 9);
+
+    /* a called function is written as code, the other stays a stub */
+    CHECK(run(env.lookup("five")->expr()) == "5\n");
+
+    Diagnostics diag;
+    std::vector<Byte> image = Image::snapshot(env);
+    Environment *copy = Image::restore(image.data(), image.size(), diag);
+    CHECK(copy != nullptr);
+    if (copy) {
+        CHECK(copy->lookup("count")->integer() == 7);
+        CHECK(copy->lookup("ratio")->floating() == 0.5);
+        CHECK(copy->lookup("name")->string().str() == "image");
+        CHECK(!copy->lookup("name")->string().is_interned());
+        /* constants come back as the one interned string */
+        String literal = copy->lookup("literal")->string();
+        CHECK(literal.is_interned());
+        CHECK(literal.node() == String::intern("literal").node());
+        CHECK(copy->lookup("block")->bytes() == 16);
+        CHECK(copy->lookup("block")->record_stride() == 4);
+        CHECK(copy->lookup("five")->function()->is_compiled());
+        CHECK(run(copy->lookup("five")->expr()) == "5\n");
+        CHECK(copy->lookup("later")->function()->is_stub());
+        CHECK(run(copy->lookup("later")->expr()) == "6\n");
+        delete copy;
+    }
+
+    /* a mapped image decodes bodies on their first call */
+    std::string path = "/tmp/image_test." + std::to_string(getpid());
+    CHECK(Image::save(path, env));
+    Environment *loaded = Image::load(path, diag);
+    CHECK(loaded != nullptr);
+    if (loaded) {
+        Function *five = loaded->lookup("five")->function();
+        CHECK(!five->is_compiled() && !five->is_stub());
+
+        /* bodies which haven't been decoded yet are written out too */
+        std::vector<Byte> again = Image::snapshot(*loaded);
+        Environment *copy = Image::restore(again.data(), again.size(), diag);
+        CHECK(copy && run(copy->lookup("five")->expr()) == "5\n");
+        delete copy;
+
+        CHECK(run(five->body()) == "5\n");
+        CHECK(five->is_compiled());
+        delete loaded;
+    }
+    unlink(path.c_str());
+
+    /* nothing of a malformed image is left behind */
+    unsigned long live = live_symbols();
+    CHECK(diag.ok());
+    CHECK(Image::restore(image.data(), image.size() / 2, diag) == nullptr);
+    CHECK(Image::restore(image.data(), image.size() - 4, diag) == nullptr);
+    CHECK(Image::restore(image.data() + 4, image.size() - 4, diag) == nullptr);
+    CHECK(live_symbols() == live);
+
+    /* failures are only reported, however many there are */
+    for (int i = 0; i < 8; i++)
+        CHECK(Image::load("/nonexistent/image", diag) == nullptr);
+    CHECK(diag.errors() == 11);
+
+    return check_result("image_test");
+}
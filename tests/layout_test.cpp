@@ -0,0 +1,70 @@
+#include <vector>
+#include "layout.hpp"
+#include "tests/check.hpp"
+
+/* every element is aligned, inside the chunk, and no two elements overlap */
+static void
+check_elements (const Layout &layout, unsigned records, LayoutMode mode)
+{
+    unsigned bytes = layout.bytes(records, mode);
+    std::vector<bool> used(bytes, false);
+    static const unsigned counts[] = { 1, 1, 1, 3 };
+    static const FieldType types[] = {
+        FIELD_BYTE, FIELD_INT, FIELD_DOUBLE, FIELD_INT
+    };
+
+    for (unsigned r = 0; r < records; r++) {
+        for (unsigned f = 0; f < layout.fields(); f++) {
+            for (unsigned e = 0; e < counts[f]; e++) {
+                unsigned size = Layout::type_size(types[f]);
+                unsigned at = layout.offset(r, f, e, records, mode);
+                CHECK(at % size == 0);
+                CHECK(at + size <= bytes);
+                for (unsigned b = at; b < at + size && b < bytes; b++) {
+                    CHECK(!used[b]);
+                    used[b] = true;
+                }
+            }
+        }
+    }
+}
+
+int
+main ()
+{
+    /* { char, int, double, int[3] } */
+    Layout layout;
+    unsigned c = layout.add(FIELD_BYTE);
+    unsigned i = layout.add(FIELD_INT);
+    unsigned d = layout.add(FIELD_DOUBLE);
+    unsigned a = layout.add(FIELD_INT, 3);
+    CHECK(layout.fields() == 4);
+
+    /* the same offsets a C compiler would pick */
+    CHECK(layout.offset(c) == 0);
+    CHECK(layout.offset(i) == 4);
+    CHECK(layout.offset(d) == 8);
+    CHECK(layout.offset(a, 2) == 24);
+    CHECK(layout.size() == 32);
+    CHECK(layout.align() == 8);
+
+    CHECK(layout.bytes(5, LAYOUT_AOS) == 5 * 32);
+    CHECK(layout.offset(3, d, 0, 5, LAYOUT_AOS) == 3 * 32 + 8);
+
+    /* columns hold 8 records each, the alignment, back to back */
+    CHECK(layout.bytes(5, LAYOUT_SOA) == 8 * (1 + 4 + 8 + 12));
+    CHECK(layout.offset(0, i, 0, 5, LAYOUT_SOA) == 8);
+    CHECK(layout.offset(2, d, 0, 5, LAYOUT_SOA) == 40 + 2 * 8);
+    CHECK(layout.offset(1, a, 2, 5, LAYOUT_SOA) == 104 + 12 + 8);
+
+    for (unsigned records = 1; records <= 17; records++) {
+        check_elements(layout, records, LAYOUT_AOS);
+        check_elements(layout, records, LAYOUT_SOA);
+    }
+
+    Layout empty;
+    CHECK(empty.size() == 0);
+    CHECK(empty.bytes(4, LAYOUT_SOA) == 0);
+
+    return check_result("layout_test");
+}
@@ -0,0 +1,71 @@
+#include <stdlib.h>
+#include <vector>
+#include "lexer.hpp"
+#include "tests/check.hpp"
+
+/* the same lexer scanning a byte at a time */
+struct ScalarLexer : Lexer {
+    ScalarLexer (const char *begin, const char *end)
+        : Lexer(begin, end)
+    {
+        simd = false;
+    }
+};
+
+template <typename L>
+static std::vector<Token>
+tokens (const std::string &text)
+{
+    std::vector<Token> out;
+    L lexer(text.data(), text.data() + text.size());
+    do
+        out.push_back(lexer.next());
+    while (out.back().type != TOKEN_EOF && out.back().type != TOKEN_ERROR);
+    return out;
+}
+
+static bool
+same (const std::vector<Token> &a, const std::vector<Token> &b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); i++)
+        if (a[i].type != b[i].type || a[i].start != b[i].start ||
+            a[i].length != b[i].length || a[i].line != b[i].line)
+            return false;
+    return true;
+}
+
+int
+main ()
+{
+    /* an unterminated comment ending in a newline just past a block */
+    const char unterminated[] = {
+        0x61, 0x2f, 0x2a, 0x30, 0x7a, 0x0a, 0x5b, 0x30, 0x09, 0x2f,
+        0x0b, 0x2f, 0x40, 0x5b, 0x5b, 0x29, 0x7a, 0x20, 0x0a,
+    };
+    std::string text(unterminated, sizeof(unterminated));
+    std::vector<Token> vector = tokens<Lexer>(text);
+    CHECK(same(vector, tokens<ScalarLexer>(text)));
+    CHECK(vector.back().type == TOKEN_ERROR);
+    CHECK(vector.back().line == 3);
+
+    /*
+     * Random text made mostly of what the scanners look for, so runs and
+     * comments often cross the edges of blocks.
+     */
+    const char alphabet[] = "  \t\n\n/*/*0123456789.abcz_[@\"(;";
+    srand(1);
+    for (int i = 0; i < 20000; i++) {
+        std::string random(rand() % 80, ' ');
+        for (auto &c : random)
+            c = alphabet[rand() % (sizeof(alphabet) - 1)];
+        if (!same(tokens<Lexer>(random), tokens<ScalarLexer>(random))) {
+            CHECK(!"SSE2 and scalar scanners disagree");
+            fprintf(stderr, "on \"%s\"\n", random.c_str());
+            break;
+        }
+    }
+
+    return check_result("lexer_test");
+}
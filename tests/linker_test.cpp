@@ -0,0 +1,53 @@
+#include "linker.hpp"
+#include "machine.hpp"
+#include "tests/check.hpp"
+
+int
+main ()
+{
+    /* x = 7 in one module, x + 7 in the next */
+    Expression store, load;
+    store.push_constant(7);
+    store.store_local("x");
+    store.finish();
+    load.load_local("x");
+    load.push_constant(7);
+    load.addi();
+    load.finish();
+
+    Linker linker;
+    CHECK(linker.add(store) == 0);
+    CHECK(linker.add(load) == 1);
+    Expression linked = linker.link();
+
+    /* one shared constant, one merged local, both halts but the last gone */
+    CHECK(linked.entry() == 1);
+    CHECK(linked.body() == 2);
+    CHECK(linked.code().size() == linked.body() + 2 + 3 + 1);
+    CHECK(run_tiers(linked) == "14\n");
+
+    /* wide constants are shared too, and every name keeps its own cache */
+    Expression a, b;
+    a.push_constant((int64_t) 1 << 40);
+    a.load_name("n");
+    a.finish();
+    b.push_constant((int64_t) 1 << 40);
+    b.load_name("n");
+    b.finish();
+
+    Linker names;
+    names.add(a);
+    names.add(b);
+    Expression both = names.link();
+    CHECK(both.entry() == 2);
+    CHECK(both.name_count() == 2);
+    CHECK(both.name_cache(0) != both.name_cache(1));
+    CHECK(both.name_cache(1)->name == "n");
+
+    /* linking again starts over with the same modules */
+    Expression again = linker.link();
+    CHECK(again.code() == linked.code());
+    CHECK(run_tiers(again) == "14\n");
+
+    return check_result("linker_test");
+}
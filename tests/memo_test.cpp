@@ -0,0 +1,81 @@
+#include "environment.hpp"
+#include "machine.hpp"
+#include "tests/check.hpp"
+
+static bool
+remembered (const Environment &env, const Expression &expr,
+            std::vector<int32_t> key, int32_t value)
+{
+    std::vector<int32_t> result;
+    return expr.recall(env.version(), key, result)
+        && result.size() == 1 && result[0] == value;
+}
+
+int
+main ()
+{
+    Environment root;
+    int a = root.register_local("a", 5);
+    root.register_local("n", 3);
+    Environment *child = root.add_child();
+    bind_environment(&root);
+
+    /* a + 1, keyed on the value of a */
+    Expression inc;
+    inc.load_global(a);
+    inc.push_constant(1);
+    inc.addi();
+    inc.finish();
+    CHECK(inc.is_pure());
+    CHECK(inc.inputs().size() == 1);
+    CHECK(run(inc) == "6\n");
+    CHECK(remembered(root, inc, {5}, 6));
+    CHECK(run(inc) == "6\n");
+
+    root.local(a)->set(0, 9);
+    CHECK(run(inc) == "10\n");
+    CHECK(remembered(root, inc, {9}, 10));
+    CHECK(remembered(root, inc, {5}, 6));
+
+    /* scratch locals are not inputs, a global read twice is one input */
+    Expression scratch;
+    scratch.push_constant(2);
+    scratch.store_local("t");
+    scratch.load_local("t");
+    scratch.load_global(a);
+    scratch.addi();
+    scratch.load_global(a);
+    scratch.addi();
+    scratch.finish();
+    CHECK(scratch.is_pure());
+    CHECK(scratch.inputs().size() == 1);
+    CHECK(run(scratch) == "20\n");
+    CHECK(run(scratch) == "20\n");
+
+    /* storing is an effect of its own */
+    Expression store;
+    store.push_constant(1);
+    store.store_global(a);
+    store.finish();
+    CHECK(!store.is_pure());
+
+    /* shadowing a name forgets everything remembered about it */
+    Expression name;
+    name.load_name("n");
+    name.finish();
+    CHECK(name.is_pure());
+    bind_environment(child);
+    CHECK(run(name) == "3\n");
+    CHECK(remembered(*child, name, {3}, 3));
+    child->register_local("n", 4);
+    CHECK(!remembered(*child, name, {3}, 3));
+    CHECK(run(name) == "4\n");
+
+    /* an input which can't be read runs and traps as usual */
+    Expression missing;
+    missing.load_name("nowhere");
+    missing.finish();
+    CHECK(run(missing) == "trap: undefined name nowhere");
+
+    return check_result("memo_test");
+}
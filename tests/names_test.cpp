@@ -0,0 +1,69 @@
+#include "environment.hpp"
+#include "machine.hpp"
+#include "parser.hpp"
+#include "tests/check.hpp"
+
+/* true if the script fails to compile in env */
+static bool
+rejected (Environment *env, const char *script)
+{
+    std::string text(script);
+    Compiler compiler(env);
+    Expression *expr = compiler.compile(text.data(), text.data() + text.size());
+    bool failed = !expr && !compiler.diagnostics().ok();
+    delete expr;
+    return failed;
+}
+
+int
+main ()
+{
+    Environment root;
+    root.register_local("n", 3);
+    Environment *left = root.add_child();
+    Environment *right = root.add_child();
+
+    /* binding a name only changes the versions of where it is visible */
+    unsigned long seen = left->version();
+    right->register_local("m", 1);
+    CHECK(left->version() == seen);
+    root.register_local("k", 2);
+    CHECK(left->version() != seen);
+    CHECK(left->version() != right->version());
+
+    /* one cache resolves afresh in every environment it's evaluated in */
+    Expression name;
+    name.load_name("n");
+    name.finish();
+    right->register_local("n", 4);
+    bind_environment(left);
+    CHECK(run(name) == "3\n");
+    bind_environment(right);
+    CHECK(run(name) == "4\n");
+    bind_environment(left);
+    CHECK(run(name) == "3\n");
+
+    /* shadowing further down is seen on the next run */
+    left->register_local("n", 5);
+    CHECK(run(name) == "5\n");
+
+    /* names of values the machine can't hold yet don't compile */
+    root.register_local("ratio", 0.5f);
+    root.register_chunk("block", 16, 4);
+    root.register_function("five", "2 + 3;");
+    Environment *child = root.add_child();
+    CHECK(rejected(child, "ratio;"));
+    CHECK(rejected(child, "block + 1;"));
+    CHECK(rejected(child, "five;"));
+    CHECK(rejected(child, "ratio = 1;"));
+    CHECK(rejected(&root, "ratio;"));
+    CHECK(rejected(&root, "int block = 1;"));
+    CHECK(!rejected(child, "n + k;"));
+
+    /* strings can't be stored yet, assigning one is an error and not a no-op */
+    root.register_local("title", std::string("t"));
+    CHECK(rejected(&root, "string s = \"x\";"));
+    CHECK(rejected(child, "title = \"y\";"));
+
+    return check_result("names_test");
+}
@@ -0,0 +1,94 @@
+#include "environment.hpp"
+#include "image.hpp"
+#include "parser.hpp"
+#include "tests/check.hpp"
+
+static bool
+compiles (Environment *env, const char *script)
+{
+    std::string text(script);
+    Compiler compiler(env);
+    Expression *expr = compiler.compile(text.data(), text.data() + text.size());
+    delete expr;
+    return expr != nullptr;
+}
+
+int
+main ()
+{
+    const unsigned long int_bytes = sizeof(Symbol) + sizeof(int);
+
+    /* environments count themselves and are refused like anything else */
+    Environment root;
+    CHECK(root.bytes_used() == sizeof(Environment));
+    Environment *child = root.add_child();
+    CHECK(child && root.bytes_used() == 2 * sizeof(Environment));
+    root.set_quota(0, root.bytes_used() + int_bytes);
+    CHECK(root.add_child() == nullptr);
+    CHECK(child->register_local("a", 1) >= 0);
+    CHECK(child->register_local("b", 2) == -1);
+    CHECK(root.bytes_used() == root.hard_quota());
+
+    /* a soft quota can be gone over, which is left to the owner to notice */
+    Environment soft;
+    soft.set_quota(soft.bytes_used() + int_bytes, 0);
+    CHECK(!soft.over_soft_quota());
+    CHECK(soft.register_local("a", 1) >= 0);
+    CHECK(!soft.over_soft_quota());
+    Environment *inner = soft.add_child();
+    CHECK(inner && soft.over_soft_quota());
+    CHECK(!inner->over_soft_quota());
+
+    /* chunks only grow through the environment which pays for them */
+    Environment chunks;
+    int block = chunks.register_chunk("block", 16, 4);
+    unsigned long used = chunks.bytes_used();
+    chunks.set_quota(0, used + 16);
+    CHECK(chunks.resize_chunk(chunks.local(block), 32));
+    CHECK(chunks.bytes_used() == used + 16);
+    CHECK(!chunks.resize_chunk(chunks.local(block), 64));
+    CHECK(chunks.local(block)->bytes() == 32);
+    CHECK(chunks.resize_chunk(chunks.local(block), 8));
+    CHECK(chunks.bytes_used() == used - 8);
+
+    /* a script's globals are bound all together or not at all */
+    Environment session;
+    session.set_quota(0, session.bytes_used() + int_bytes);
+    CHECK(!compiles(&session, "int x = 1; int y = 2; x + y;"));
+    CHECK(session.local_index("x") == -1);
+    CHECK(session.bytes_used() == sizeof(Environment));
+    CHECK(compiles(&session, "int x = 1; x;"));
+    CHECK(session.local_index("x") == 0);
+
+    /* a function pays for its body once it's compiled */
+    Environment funcs;
+    funcs.register_function("sum", "1 + 2 + 3;");
+    used = funcs.bytes_used();
+    Function *sum = funcs.lookup("sum")->function();
+    CHECK(sum->body() != nullptr);
+    CHECK(funcs.bytes_used() == used + sum->body()->bytes());
+    funcs.register_function("tight", "4 + 5;");
+    funcs.set_quota(0, funcs.bytes_used());
+    Function *tight = funcs.lookup("tight")->function();
+    CHECK(tight->body() == nullptr);
+    CHECK(!tight->diagnostics().ok());
+    CHECK(funcs.bytes_used() == funcs.hard_quota());
+
+    /* images keep their quotas and are refused if they don't fit them */
+    Diagnostics diag;
+    std::vector<Byte> image = Image::snapshot(root);
+    Environment *copy = Image::restore(image.data(), image.size(), diag);
+    CHECK(copy != nullptr);
+    if (copy) {
+        CHECK(copy->hard_quota() == root.hard_quota());
+        CHECK(copy->bytes_used() == root.bytes_used());
+        CHECK(copy->register_local("c", 3) == -1);
+        delete copy;
+    }
+    root.set_quota(0, root.bytes_used() - 1);
+    image = Image::snapshot(root);
+    CHECK(Image::restore(image.data(), image.size(), diag) == nullptr);
+    CHECK(diag.errors() == 1);
+
+    return check_result("quota_test");
+}
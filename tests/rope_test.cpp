@@ -0,0 +1,63 @@
+#include "rope.hpp"
+#include "symbol.hpp"
+#include "tests/check.hpp"
+
+int
+main ()
+{
+    String empty;
+    CHECK(empty.length() == 0);
+    CHECK(empty.str() == "");
+    CHECK(empty == String(""));
+
+    /* short results are flattened, long ones are nodes over the originals */
+    String hello("hello, ");
+    String world("world");
+    String greeting = hello.concat(world);
+    CHECK(greeting.str() == "hello, world");
+    CHECK(greeting.at(7) == 'w');
+    CHECK(greeting.slice(7, 100).str() == "world");
+    CHECK(greeting.slice(100, 1).length() == 0);
+
+    std::string expect;
+    String rope;
+    for (int i = 0; i < 200; i++) {
+        std::string part = "part " + std::to_string(i) + "; ";
+        expect += part;
+        rope = rope.concat(String(part));
+    }
+    CHECK(rope.length() == expect.size());
+    CHECK(rope.str() == expect);
+    for (size_t i = 0; i < expect.size(); i += 97)
+        CHECK(rope.at(i) == expect[i]);
+
+    /* slices of slices, long enough to stay views */
+    String middle = rope.slice(100, 1000);
+    String inner = middle.slice(250, 400);
+    CHECK(middle.str() == expect.substr(100, 1000));
+    CHECK(inner.str() == expect.substr(350, 400));
+    CHECK(inner == String(expect.substr(350, 400)));
+    CHECK(inner != middle);
+
+    /* interned strings share one node, heap strings never do */
+    String a = String::intern("literal");
+    String b = String::intern(std::string("lit") + "eral");
+    CHECK(a.node() == b.node());
+    CHECK(a.is_interned());
+    CHECK(!String("literal").is_interned());
+    CHECK(String("literal") == a);
+
+    /* symbols count their reference to the string */
+    String shared("not interned, shared between symbols");
+    {
+        Symbol sym(shared);
+        Symbol copy(sym);
+        Symbol *heap = sym.allocate();
+        CHECK(heap->string() == shared);
+        delete heap;
+        CHECK(copy.string().node() == shared.node());
+    }
+    CHECK(shared.str() == "not interned, shared between symbols");
+
+    return check_result("rope_test");
+}
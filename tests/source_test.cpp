@@ -0,0 +1,76 @@
+#include <sstream>
+#include <stdlib.h>
+#include <unistd.h>
+#include "environment.hpp"
+#include "machine.hpp"
+#include "parser.hpp"
+#include "source.hpp"
+#include "tests/check.hpp"
+
+/* write text to a new temporary file and return its path */
+static std::string
+script (const std::string &text)
+{
+    char path[] = "/tmp/source_testXXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    CHECK(write(fd, text.data(), text.size()) == (ssize_t) text.size());
+    close(fd);
+    return path;
+}
+
+/* map the script at path, compile it and evaluate it */
+static std::string
+run_file (const std::string &path)
+{
+    Diagnostics diag;
+    Source source(path, diag);
+    unlink(path.c_str());
+    if (!source.ok())
+        return "not ok";
+
+    Environment env;
+    bind_environment(&env);
+    Compiler compiler(&env);
+    Expression *expr = compiler.compile(source.begin(), source.end());
+    std::ostringstream out;
+    if (expr) {
+        Result result = evaluate(*expr, out);
+        if (!result.ok)
+            out << "trap: " << result.trap;
+    } else {
+        out << "no expression";
+    }
+    delete expr;
+    bind_environment(nullptr);
+    return out.str();
+}
+
+int
+main ()
+{
+    CHECK(run_file(script("int a = 4;\na * 2;\n")) == "8\n");
+
+    /* the last token runs right up to the end of the mapping */
+    CHECK(run_file(script("int a = 4; a * 25")) == "no expression");
+    CHECK(run_file(script("int a = 4; a * 25;")) == "100\n");
+    CHECK(run_file(script("123;")) == "123\n");
+
+    /* an empty file isn't mapped at all, nor is there anything to print */
+    std::string empty = script("");
+    Diagnostics diag;
+    {
+        Source source(empty, diag);
+        CHECK(source.ok() && source.size() == 0);
+        CHECK(source.begin() == source.end());
+    }
+    CHECK(diag.ok());
+    CHECK(run_file(empty) == "OK\n");
+
+    /* a file which doesn't exist is reported */
+    Source missing("/tmp/source_test_missing", diag);
+    CHECK(!missing.ok());
+    CHECK(diag.errors() == 1);
+
+    return check_result("source_test");
+}
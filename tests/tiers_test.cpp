@@ -0,0 +1,77 @@
+#include <sstream>
+#include "environment.hpp"
+#include "machine.hpp"
+#include "parser.hpp"
+#include "tests/check.hpp"
+
+/*
+ * Compile a script and run it in every tier, each against its own copy of
+ * the globals. Returns what the switch interpreter printed, or its trap.
+ */
+static std::string
+differ (const std::string &script)
+{
+    std::string outputs[3];
+    Result results[3];
+
+    for (int tier = 0; tier < 3; tier++) {
+        Environment env;
+        bind_environment(&env);
+        Compiler compiler(&env);
+        Expression *expr = compiler.compile(script.data(),
+                                            script.data() + script.size());
+        if (!expr)
+            return "no expression";
+
+        std::ostringstream out;
+        if (tier == 0) {
+            results[tier] = evaluate(*expr, out);
+        } else if (tier == 1) {
+            results[tier] = evaluate_cached(*expr, out);
+        } else {
+            Compiled compiled(*expr);
+            results[tier] = evaluate(compiled, out);
+        }
+        outputs[tier] = out.str();
+        delete expr;
+        bind_environment(nullptr);
+    }
+
+    for (int tier = 1; tier < 3; tier++) {
+        if (results[tier].ok != results[0].ok ||
+            results[tier].trap != results[0].trap ||
+            outputs[tier] != outputs[0]) {
+            fprintf(stderr, "tier %d differs on \"%s\"\n", tier,
+                    script.c_str());
+            CHECK(!"tiers disagree");
+        }
+    }
+    return results[0].ok ? outputs[0] : "trap: " + results[0].trap;
+}
+
+int
+main ()
+{
+    CHECK(differ("1 + 2 * 3;") == "7\n");
+    CHECK(differ("8 - 10 + 4;") == "2\n");
+    CHECK(differ("-(2 + 3) + 12;") == "7\n");
+    CHECK(differ("(1 == 1) + (2 < 3) + (4 > 5) + (1 != 1);") == "2\n");
+
+    /* locals and globals, which stay in the stack cache or spill out of it */
+    CHECK(differ("int a = 14; int b = 18; 3 * a / 2 - b;") == "3\n");
+    CHECK(differ("int a = 1; int b = 2; int c = 3; a + (b + (c + a * b));")
+          == "8\n");
+    CHECK(differ("int g = 3; g = g * g; g;") == "9\n");
+
+    /* far more statements than there are stack slots */
+    std::string many;
+    for (int i = 0; i < 300; i++)
+        many += std::to_string(i) + "; ";
+    CHECK(differ(many + "5;") == "5\n");
+
+    /* traps are the same in every tier too */
+    CHECK(differ("1 / 0;") == "trap: division by zero or overflow");
+    CHECK(differ("int z = 0; 7 / z;") == "trap: division by zero or overflow");
+
+    return check_result("tiers_test");
+}
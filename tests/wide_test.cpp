@@ -0,0 +1,77 @@
+#include "encoding.hpp"
+#include "linker.hpp"
+#include "machine.hpp"
+#include "tests/check.hpp"
+
+int
+main ()
+{
+    /* both words of a long, not just the high one */
+    Expression sum;
+    sum.push_constant((int64_t) 1 << 40);
+    sum.push_constant((int64_t) 3);
+    sum.addl();
+    sum.finish();
+    CHECK(sum.result_kind() == VALUE_LONG);
+    CHECK(run_tiers(sum) == "1099511627779\n");
+
+    Expression negative;
+    negative.push_constant((int64_t) 2);
+    negative.push_constant((int64_t) -7);
+    negative.mull();
+    negative.finish();
+    CHECK(run_tiers(negative) == "-14\n");
+
+    Expression product;
+    product.push_constant(1.5);
+    product.push_constant(2.25);
+    product.muld();
+    product.finish();
+    CHECK(product.result_kind() == VALUE_DOUBLE);
+    CHECK(run_tiers(product) == "3.375\n");
+
+    Expression literal;
+    literal.push_constant(-0.5);
+    literal.finish();
+    CHECK(run_tiers(literal) == "-0.5\n");
+
+    /* plain ints print as before */
+    Expression compare;
+    compare.push_constant(7);
+    compare.push_constant(3);
+    compare.subi();
+    compare.finish();
+    CHECK(compare.result_kind() == VALUE_INT);
+    CHECK(run_tiers(compare) == "4\n");
+
+    /* storing leaves the value underneath on top */
+    Expression stored;
+    stored.push_constant((int64_t) 1 << 33);
+    stored.push_constant(5);
+    stored.store_local("x");
+    stored.finish();
+    CHECK(stored.result_kind() == VALUE_LONG);
+    CHECK(run_tiers(stored) == "8589934592\n");
+
+    /* linked, the last module with a value of its own decides */
+    Expression nothing;
+    nothing.push_constant(1);
+    nothing.store_local("y");
+    nothing.finish();
+    CHECK(nothing.result_kind() == VALUE_NONE);
+    Linker linker;
+    linker.add(sum);
+    linker.add(nothing);
+    Expression linked = linker.link();
+    CHECK(linked.result_kind() == VALUE_LONG);
+    CHECK(run_tiers(linked) == "1099511627779\n");
+
+    /* and the kind survives encoding */
+    std::vector<uint8_t> bytes = Encoding::encode(product);
+    Expression decoded;
+    CHECK(Encoding::decode(bytes.data(), bytes.size(), decoded));
+    CHECK(decoded.result_kind() == VALUE_DOUBLE);
+    CHECK(run_tiers(decoded) == "3.375\n");
+
+    return check_result("wide_test");
+}